@@ -0,0 +1,63 @@
+/*
+ * CongestionControl.cpp
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#include "CongestionControl.h"
+
+CongestionControl::CongestionControl() {
+  cwnd = INITIALWINDOW;
+  ssthresh = numeric_limits<double>::max();
+  maxWindow = numeric_limits<int>::max();
+}
+
+CongestionControl::~CongestionControl() {
+}
+
+void CongestionControl::onAck(int acked, time_duration rtt) {
+  handleAck(acked, rtt);
+  clamp();
+}
+
+void CongestionControl::onLoss(int inFlight) {
+  handleLoss(inFlight);
+  clamp();
+}
+
+void CongestionControl::onTimeout(int inFlight) {
+  handleTimeout(inFlight);
+  clamp();
+}
+
+int CongestionControl::getWindow() {
+  return (int) cwnd;
+}
+
+double CongestionControl::getCwnd() {
+  return cwnd;
+}
+
+double CongestionControl::getSsthresh() {
+  return ssthresh;
+}
+
+void CongestionControl::setMaxWindow(int packets) {
+  maxWindow = (packets > MINIMUMWINDOW) ? packets : MINIMUMWINDOW;
+  clamp();
+}
+
+bool CongestionControl::inSlowStart() {
+  return cwnd < ssthresh;
+}
+
+void CongestionControl::clamp() {
+  // an application limited sender would otherwise
+  // grow the window without bound
+  if (cwnd > maxWindow) {
+    cwnd = maxWindow;
+  }
+  if (cwnd < 1) {
+    cwnd = 1;
+  }
+}
@@ -0,0 +1,68 @@
+/*
+ * CongestionControl.h
+ *
+ *  Created on: Oct 16, 2026
+ *
+ *  The CongestionControl class is the strategy a
+ *  UDPPlusConnection consults before putting another packet
+ *  in flight.  It keeps a congestion window and slow start
+ *  threshold, counted in packets, and is told about acks,
+ *  fast retransmits and retransmission timeouts.  Subclasses
+ *  decide how the window reacts to each event.
+ */
+
+//          Copyright Joe Coder 2004 - 2006.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+
+#ifndef CONGESTIONCONTROL_H_
+#define CONGESTIONCONTROL_H_
+
+#include "utility.h"
+
+using namespace boost::posix_time;
+
+class CongestionControl {
+public:
+  const static int INITIALWINDOW = 10; // packets, as in RFC 6928
+  const static int MINIMUMWINDOW = 2;
+
+  CongestionControl();
+  virtual ~CongestionControl();
+
+  // acked packets left the network, rtt is the smoothed round trip
+  void onAck(int acked, time_duration rtt);
+  // a packet was fast retransmitted, once per window of data
+  void onLoss(int inFlight);
+  // the retransmission timer expired
+  void onTimeout(int inFlight);
+
+  // number of packets that may be in flight
+  int getWindow();
+  double getCwnd();
+  double getSsthresh();
+
+  // the window never grows past what the connection can buffer
+  void setMaxWindow(int packets);
+
+  virtual const char* getName() = 0;
+
+protected:
+  virtual void handleAck(int acked, time_duration rtt) = 0;
+  virtual void handleLoss(int inFlight) = 0;
+  virtual void handleTimeout(int inFlight) = 0;
+
+  bool inSlowStart();
+
+  double cwnd;
+  double ssthresh;
+
+private:
+  void clamp();
+
+  int maxWindow;
+};
+
+#endif /* CONGESTIONCONTROL_H_ */
@@ -0,0 +1,41 @@
+/*
+ * ConnectionDemux.cpp
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#include "ConnectionDemux.h"
+
+ConnectionDemux::ConnectionDemux(int capacity) {
+  table.rehash((size_t) ceil(capacity / table.max_load_factor()));
+}
+
+uint64_t ConnectionDemux::makeKey(const struct sockaddr *remote, socklen_t length) {
+  const struct sockaddr_in *address = (const struct sockaddr_in *) remote;
+  // sockets are created as AF_INET, so family, port and
+  // address together identify the peer completely
+  uint64_t key = (uint64_t) address->sin_family << 48;
+  key |= (uint64_t) ntohs(address->sin_port) << 32;
+  key |= (uint64_t) ntohl(address->sin_addr.s_addr);
+  return key;
+}
+
+int ConnectionDemux::find(const struct sockaddr *remote, socklen_t length) const {
+  boost::unordered_map<uint64_t, int>::const_iterator it = table.find(makeKey(remote, length));
+  if (it == table.end()) {
+    return -1;
+  }
+  return it->second;
+}
+
+bool ConnectionDemux::insert(const struct sockaddr *remote, socklen_t length, int slot) {
+  return table.insert(std::make_pair(makeKey(remote, length), slot)).second;
+}
+
+void ConnectionDemux::erase(const struct sockaddr *remote, socklen_t length) {
+  table.erase(makeKey(remote, length));
+}
+
+size_t ConnectionDemux::size() const {
+  return table.size();
+}
@@ -0,0 +1,51 @@
+/*
+ * ConnectionDemux.h
+ *
+ *  Created on: Oct 16, 2026
+ *
+ *  The ConnectionDemux class maps a remote peer address
+ *  to its slot in UDPPlus::connectionList.  It replaces
+ *  the linear walk over connectionList with a hash lookup
+ *  so every incoming datagram is routed in constant time.
+ */
+
+//          Copyright Joe Coder 2004 - 2006.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+
+#ifndef CONNECTIONDEMUX_H_
+#define CONNECTIONDEMUX_H_
+
+#include "utility.h"
+
+#include <boost/unordered_map.hpp>
+
+class ConnectionDemux {
+public:
+  // reserves room for capacity peers so the table
+  // never rehashes while the listener is running
+  ConnectionDemux(int capacity);
+
+  // returns the slot registered for the given peer
+  // returns -1 if the peer is not known
+  int find(const struct sockaddr *remote, socklen_t length) const;
+
+  // registers a peer with its connectionList slot
+  // returns false if the peer is already registered
+  bool insert(const struct sockaddr *remote, socklen_t length, int slot);
+
+  // removes a peer from the table
+  void erase(const struct sockaddr *remote, socklen_t length);
+
+  size_t size() const;
+
+  // packs family, port and IPv4 address into a single key
+  static uint64_t makeKey(const struct sockaddr *remote, socklen_t length);
+
+private:
+  boost::unordered_map<uint64_t, int> table;
+};
+
+#endif /* CONNECTIONDEMUX_H_ */
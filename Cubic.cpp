@@ -0,0 +1,84 @@
+/*
+ * Cubic.cpp
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#include "Cubic.h"
+
+// constants from RFC 8312, C is in packets per second cubed
+const double CUBICC = 0.4;
+const double CUBICBETA = 0.7;
+
+Cubic::Cubic() {
+  wMax = 0;
+  k = 0;
+  originPoint = 0;
+  renoWindow = 0;
+}
+
+const char* Cubic::getName() {
+  return "cubic";
+}
+
+void Cubic::handleAck(int acked, time_duration rtt) {
+  if (inSlowStart()) {
+    cwnd += acked;
+    return;
+  }
+
+  ptime now = microsec_clock::universal_time();
+  if (epochStart.is_not_a_date_time()) {
+    epochStart = now;
+    if (cwnd < wMax) {
+      k = cbrt((wMax - cwnd) / CUBICC);
+      originPoint = wMax;
+    }
+    else {
+      k = 0;
+      originPoint = cwnd;
+    }
+    renoWindow = cwnd;
+  }
+
+  // aim for where the cubic will be one round trip from now
+  double t = (now - epochStart + rtt).total_microseconds() / 1000000.0;
+  double target = originPoint + CUBICC * (t - k) * (t - k) * (t - k);
+  if (target > cwnd) {
+    cwnd += (target - cwnd) / cwnd * acked;
+  }
+  else {
+    cwnd += 0.01 * acked / cwnd;
+  }
+
+  renoWindow += 3 * (1 - CUBICBETA) / (1 + CUBICBETA) * acked / cwnd;
+  if (renoWindow > cwnd) {
+    cwnd = renoWindow;
+  }
+}
+
+void Cubic::handleLoss(int inFlight) {
+  reduce();
+  cwnd = ssthresh;
+}
+
+void Cubic::handleTimeout(int inFlight) {
+  reduce();
+  cwnd = 1;
+}
+
+void Cubic::reduce() {
+  epochStart = ptime();
+  // fast convergence, a flow losing ground gives some up
+  // so newer flows can reach their share sooner
+  if (cwnd < wMax) {
+    wMax = cwnd * (1 + CUBICBETA) / 2;
+  }
+  else {
+    wMax = cwnd;
+  }
+  ssthresh = cwnd * CUBICBETA;
+  if (ssthresh < MINIMUMWINDOW) {
+    ssthresh = MINIMUMWINDOW;
+  }
+}
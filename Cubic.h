@@ -0,0 +1,47 @@
+/*
+ * Cubic.h
+ *
+ *  Created on: Oct 16, 2026
+ *
+ *  The Cubic class is CUBIC congestion control from RFC 8312.
+ *  After a loss the window follows a cubic function of the
+ *  time since that loss, flattening out near the window where
+ *  the loss happened and probing past it afterwards, so growth
+ *  does not depend on the round trip time.  A Reno estimate is
+ *  kept alongside so short paths are never slower than NewReno.
+ */
+
+//          Copyright Joe Coder 2004 - 2006.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+
+#ifndef CUBIC_H_
+#define CUBIC_H_
+
+#include "CongestionControl.h"
+
+class Cubic : public CongestionControl {
+public:
+  Cubic();
+
+  virtual const char* getName();
+
+protected:
+  virtual void handleAck(int acked, time_duration rtt);
+  virtual void handleLoss(int inFlight);
+  virtual void handleTimeout(int inFlight);
+
+private:
+  // records the window at the loss and shrinks the window
+  void reduce();
+
+  double wMax;        // window just before the last reduction
+  double k;           // seconds the cubic takes to climb back to wMax
+  double originPoint; // window the cubic is centred on
+  double renoWindow;  // what NewReno would have by now
+  ptime epochStart;   // start of the current growth period
+};
+
+#endif /* CUBIC_H_ */
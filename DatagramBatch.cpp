@@ -0,0 +1,189 @@
+/*
+ * DatagramBatch.cpp
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#include "DatagramBatch.h"
+
+DatagramBatch::DatagramBatch(int capacity, size_t bufferLength, bool allocateBuffers) {
+  this->capacity = (capacity < 1) ? 1 : capacity;
+  this->bufferLength = bufferLength;
+  count = 0;
+
+  buffers = allocateBuffers ? new char[this->capacity * bufferLength] : NULL;
+  addresses = new struct sockaddr[this->capacity];
+  vectors = new struct iovec[this->capacity];
+#ifdef __linux__
+  headers = new struct mmsghdr[this->capacity];
+  memset(headers, 0, sizeof(struct mmsghdr) * this->capacity);
+#else
+  lengths = new size_t[this->capacity];
+  addressLengths = new socklen_t[this->capacity];
+#endif
+
+  for (int i = 0; i < this->capacity; i++) {
+    vectors[i].iov_base = allocateBuffers ? buffers + i * bufferLength : NULL;
+    vectors[i].iov_len = bufferLength;
+#ifdef __linux__
+    headers[i].msg_hdr.msg_name = &addresses[i];
+    headers[i].msg_hdr.msg_iov = &vectors[i];
+    headers[i].msg_hdr.msg_iovlen = 1;
+#endif
+  }
+}
+
+DatagramBatch::~DatagramBatch() {
+  delete[] buffers;
+  delete[] addresses;
+  delete[] vectors;
+#ifdef __linux__
+  delete[] headers;
+#else
+  delete[] lengths;
+  delete[] addressLengths;
+#endif
+}
+
+int DatagramBatch::receive(int sockfd) {
+  count = 0;
+#ifdef __linux__
+  for (int i = 0; i < capacity; i++) {
+    vectors[i].iov_len = bufferLength;
+    headers[i].msg_hdr.msg_namelen = sizeof(struct sockaddr);
+    headers[i].msg_len = 0;
+  }
+  // MSG_WAITFORONE blocks for the first datagram only
+  int received = recvmmsg(sockfd, headers, capacity, MSG_WAITFORONE, NULL);
+  if (received < 0) {
+    return -1;
+  }
+  count = received;
+#else
+  int flags = 0;
+  while (count < capacity) {
+    addressLengths[count] = sizeof(struct sockaddr);
+    ssize_t length = recvfrom(sockfd, vectors[count].iov_base, bufferLength, flags,
+        &addresses[count], &addressLengths[count]);
+    if (length < 0) {
+      if (count == 0) return -1;
+      break;
+    }
+    lengths[count++] = length;
+    flags = MSG_DONTWAIT;
+  }
+#endif
+  return count;
+}
+
+bool DatagramBatch::add(const struct sockaddr *remote, socklen_t remoteLength,
+    const void *data, size_t length) {
+  if (count == capacity || length > bufferLength) {
+    return false;
+  }
+  memcpy(&addresses[count], remote, remoteLength);
+  memcpy(vectors[count].iov_base, data, length);
+  vectors[count].iov_len = length;
+#ifdef __linux__
+  headers[count].msg_hdr.msg_namelen = remoteLength;
+  headers[count].msg_len = length;
+#else
+  lengths[count] = length;
+  addressLengths[count] = remoteLength;
+#endif
+  count++;
+  return true;
+}
+
+bool DatagramBatch::retryable(int error) {
+  return error == EAGAIN || error == EWOULDBLOCK || error == ENOBUFS || error == EINTR;
+}
+
+int DatagramBatch::flush(int sockfd) {
+  int sent = 0;
+  int position = 0;
+  int attempts = 0;
+#ifdef __linux__
+  while (position < count) {
+    int result = sendmmsg(sockfd, headers + position, count - position, 0);
+    if (result >= 0) {
+      sent += result;
+      position += result;
+      attempts = 0;
+      continue;
+    }
+    if (retryable(errno) && attempts++ < SENDRETRIES) {
+      continue;
+    }
+    // a datagram longer than the link is lost as on the wire, one
+    // the socket refuses is dropped, either way the rest still go
+    if (errno == EMSGSIZE) {
+      sent++;
+    }
+    position++;
+    attempts = 0;
+  }
+#else
+  for (; position < count; position++) {
+    int result;
+    do {
+      result = sendto(sockfd, vectors[position].iov_base, lengths[position], 0,
+          &addresses[position], addressLengths[position]);
+    } while (result < 0 && retryable(errno) && attempts++ < SENDRETRIES);
+    attempts = 0;
+    if (result >= 0 || errno == EMSGSIZE) {
+      sent++;
+    }
+  }
+#endif
+  count = 0;
+  return sent;
+}
+
+void DatagramBatch::clear() {
+  count = 0;
+}
+
+void DatagramBatch::setBuffer(int index, char *buffer) {
+  vectors[index].iov_base = buffer;
+}
+
+char* DatagramBatch::getBuffer(int index) {
+  return (char *) vectors[index].iov_base;
+}
+
+size_t DatagramBatch::getLength(int index) {
+#ifdef __linux__
+  return headers[index].msg_len;
+#else
+  return lengths[index];
+#endif
+}
+
+struct sockaddr* DatagramBatch::getAddress(int index) {
+  return &addresses[index];
+}
+
+socklen_t DatagramBatch::getAddressLength(int index) {
+#ifdef __linux__
+  return headers[index].msg_hdr.msg_namelen;
+#else
+  return addressLengths[index];
+#endif
+}
+
+int DatagramBatch::size() {
+  return count;
+}
+
+int DatagramBatch::getCapacity() {
+  return capacity;
+}
+
+bool DatagramBatch::empty() {
+  return count == 0;
+}
+
+bool DatagramBatch::full() {
+  return count == capacity;
+}
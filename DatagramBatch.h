@@ -0,0 +1,91 @@
+/*
+ * DatagramBatch.h
+ *
+ *  Created on: Oct 16, 2026
+ *
+ *  The DatagramBatch class holds a fixed number of datagram
+ *  buffers with their addresses so that many datagrams can be
+ *  received with one recvmmsg() or sent with one sendmmsg().
+ *  Where those calls do not exist it falls back to one
+ *  recvfrom()/sendto() per datagram.
+ */
+
+//          Copyright Joe Coder 2004 - 2006.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+
+#ifndef DATAGRAMBATCH_H_
+#define DATAGRAMBATCH_H_
+
+#include "utility.h"
+
+class DatagramBatch {
+public:
+  // times a send the socket refused for now is tried again
+  // before the datagram is dropped
+  const static int SENDRETRIES = 3;
+
+  // true if a send that failed with error may succeed when
+  // tried again, the socket's buffer or the device queue was full
+  static bool retryable(int error);
+
+  // allocates capacity buffers of bufferLength bytes each
+  // with allocateBuffers false every slot must be given a
+  // buffer through setBuffer before it is used
+  DatagramBatch(int capacity, size_t bufferLength, bool allocateBuffers = true);
+  ~DatagramBatch();
+
+  // blocks until at least one datagram arrives, then takes
+  // as many as are queued up to capacity without blocking
+  // returns the number received, -1 if the socket failed
+  int receive(int sockfd);
+
+  // copies a datagram into the next free slot
+  // returns false if the batch is full or the datagram is too large
+  // a transport other than a socket receives this way too
+  bool add(const struct sockaddr *remote, socklen_t remoteLength,
+      const void *data, size_t length);
+
+  // sends every queued datagram and empties the batch
+  // returns the number sent, those too long for the link
+  // included.  a datagram the socket still refuses after
+  // SENDRETRIES is dropped and the rest are sent, errno
+  // says why the last one was refused
+  int flush(int sockfd);
+
+  // empties the batch without sending anything
+  void clear();
+
+  // points a slot at a caller owned buffer of bufferLength bytes
+  // lets datagrams be received directly into their final storage
+  void setBuffer(int index, char *buffer);
+
+  char* getBuffer(int index);
+  size_t getLength(int index);
+  struct sockaddr* getAddress(int index);
+  socklen_t getAddressLength(int index);
+
+  int size();
+  int getCapacity();
+  bool empty();
+  bool full();
+
+private:
+  int capacity;
+  size_t bufferLength;
+  int count;
+
+  char *buffers;
+  struct sockaddr *addresses;
+  struct iovec *vectors;
+#ifdef __linux__
+  struct mmsghdr *headers;
+#else
+  size_t *lengths;
+  socklen_t *addressLengths;
+#endif
+};
+
+#endif /* DATAGRAMBATCH_H_ */
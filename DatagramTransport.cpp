@@ -0,0 +1,13 @@
+/*
+ * DatagramTransport.cpp
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#include "DatagramTransport.h"
+
+DatagramTransport::DatagramTransport() {
+}
+
+DatagramTransport::~DatagramTransport() {
+}
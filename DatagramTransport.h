@@ -0,0 +1,52 @@
+/*
+ * DatagramTransport.h
+ *
+ *  Created on: Oct 16, 2026
+ *
+ *  The DatagramTransport class stands in for the UDP socket
+ *  underneath a UDPPlus object.  By default UDPPlus talks to
+ *  the kernel directly; given a transport through setTransport
+ *  it sends and receives every datagram through it instead,
+ *  so the protocol can run over an emulated network.
+ */
+
+//          Copyright Joe Coder 2004 - 2006.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+
+#ifndef DATAGRAMTRANSPORT_H_
+#define DATAGRAMTRANSPORT_H_
+
+#include "utility.h"
+#include "DatagramBatch.h"
+
+#include <sys/uio.h>
+
+class DatagramTransport {
+public:
+  DatagramTransport();
+  virtual ~DatagramTransport();
+
+  // takes a local address, as bind does for a socket
+  // a transport that is never bound picks one on its first send
+  // returns -1 with errno set on failure
+  virtual int bind(const struct sockaddr *address, socklen_t length) = 0;
+
+  // sends the segments of iov as one datagram
+  // a datagram lost on the way is not an error, one too long
+  // for the path returns -1 with errno set to EMSGSIZE
+  virtual int send(const struct sockaddr *to, socklen_t toLength,
+      const struct iovec *iov, int iovcnt) = 0;
+
+  // blocks until at least one datagram arrives, then fills
+  // batch with as many as are waiting, like DatagramBatch::receive
+  // returns the number received, -1 once closed
+  virtual int receive(DatagramBatch &batch) = 0;
+
+  // wakes a thread blocked in receive, later calls return -1
+  virtual void close() = 0;
+};
+
+#endif /* DATAGRAMTRANSPORT_H_ */
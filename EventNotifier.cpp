@@ -0,0 +1,74 @@
+/*
+ * EventNotifier.cpp
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#include "EventNotifier.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+EventNotifier::EventNotifier() {
+  readFd = writeFd = -1;
+  signalled = false;
+}
+
+EventNotifier::~EventNotifier() {
+  if (readFd >= 0) {
+    close(readFd);
+  }
+  if (writeFd >= 0 && writeFd != readFd) {
+    close(writeFd);
+  }
+}
+
+int EventNotifier::descriptor() {
+  if (readFd >= 0) {
+    return readFd;
+  }
+#ifdef __linux__
+  readFd = writeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (readFd < 0) {
+    return -1;
+  }
+#else
+  int ends[2];
+  if (pipe(ends) < 0) {
+    return -1;
+  }
+  for (int i = 0; i < 2; i++) {
+    fcntl(ends[i], F_SETFL, fcntl(ends[i], F_GETFL) | O_NONBLOCK);
+    fcntl(ends[i], F_SETFD, FD_CLOEXEC);
+  }
+  readFd = ends[0];
+  writeFd = ends[1];
+#endif
+  signal();
+  return readFd;
+}
+
+void EventNotifier::signal() {
+  if (writeFd < 0 || signalled) {
+    return;
+  }
+  uint64_t one = 1;
+  // a full pipe or counter is already readable
+  if (write(writeFd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+    return;
+  }
+  signalled = true;
+}
+
+void EventNotifier::reset() {
+  if (readFd < 0 || !signalled) {
+    return;
+  }
+  uint64_t drained;
+  while (read(readFd, &drained, sizeof(drained)) > 0) {
+  }
+  signalled = false;
+}
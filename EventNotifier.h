@@ -0,0 +1,51 @@
+/*
+ * EventNotifier.h
+ *
+ *  Created on: Oct 16, 2026
+ *
+ *  The EventNotifier class is a descriptor an application can
+ *  hand to select, poll or epoll to learn that a non-blocking
+ *  call may now succeed.  It is an eventfd on Linux and a pipe
+ *  elsewhere.  The descriptor is opened on first use, so
+ *  applications that only make blocking calls never pay for it.
+ *
+ *  The owner signals it when something may have become ready
+ *  and resets it once a call finds nothing to do, so the
+ *  descriptor stays readable until then.  The owner's lock
+ *  guards every call.
+ */
+
+//          Copyright Joe Coder 2004 - 2006.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+
+#ifndef EVENTNOTIFIER_H_
+#define EVENTNOTIFIER_H_
+
+#include "utility.h"
+
+class EventNotifier : private boost::noncopyable {
+public:
+  EventNotifier();
+  ~EventNotifier();
+
+  // opens the descriptor, readable at first so the
+  // application checks once for what is already ready
+  // returns -1 if it could not be opened
+  int descriptor();
+
+  // makes the descriptor readable
+  // does nothing if it is not open or already readable
+  void signal();
+  // drains the descriptor until the next signal
+  void reset();
+
+private:
+  int readFd;
+  int writeFd;   // the same as readFd for an eventfd
+  bool signalled;
+};
+
+#endif /* EVENTNOTIFIER_H_ */
@@ -0,0 +1,182 @@
+/*
+ * Executor.cpp
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#include "Executor.h"
+#include "Logger.h"
+
+#ifdef UDPPLUS_COROUTINES
+
+#include <unistd.h>
+#include <poll.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+
+static thread_local Executor *running = NULL;
+
+// a spawned session has no caller to rethrow its exception to
+static void reportFailure(std::exception_ptr failure) {
+  try {
+    std::rethrow_exception(failure);
+  }
+  catch (const std::exception &e) {
+    UDPPLUS_WARN("executor: session ended by an exception: %s", e.what());
+  }
+  catch (...) {
+    UDPPLUS_WARN("executor: session ended by an exception");
+  }
+}
+
+Executor::Executor() {
+  sessions = 0;
+#ifdef __linux__
+  epollFd = epoll_create1(EPOLL_CLOEXEC);
+#else
+  epollFd = -1;
+#endif
+}
+
+Executor::~Executor() {
+  // destroying a session destroys the tasks it awaits
+  for (size_t i = 0; i < roots.size(); i++) {
+    roots[i].destroy();
+  }
+  if (epollFd >= 0) {
+    close(epollFd);
+  }
+}
+
+void Executor::spawn(Task<void> task) {
+  Task<void>::Handle h = task.handle;
+  task.handle = Task<void>::Handle();
+  h.promise().sessions = &sessions;
+  sessions++;
+  roots.push_back(h);
+  ready.push_back(h);
+}
+
+void Executor::run() {
+  Executor *outer = running;
+  running = this;
+  while (sessions > 0) {
+    while (!ready.empty()) {
+      std::coroutine_handle<> h = ready.front();
+      ready.pop_front();
+      h.resume();
+    }
+    // free the sessions that finished on this pass
+    size_t kept = 0;
+    for (size_t i = 0; i < roots.size(); i++) {
+      if (roots[i].done()) {
+        if (roots[i].promise().failure) {
+          reportFailure(roots[i].promise().failure);
+        }
+        roots[i].destroy();
+      } else {
+        roots[kept++] = roots[i];
+      }
+    }
+    roots.resize(kept);
+    if (sessions == 0) {
+      break;
+    }
+    if (waiters.empty()) {
+      UDPPLUS_WARN("executor: %d sessions suspended on nothing", sessions);
+      break;
+    }
+    poll();
+  }
+  running = outer;
+}
+
+Executor* Executor::current() {
+  return running;
+}
+
+Executor::Readable Executor::readable(int fd) {
+  Readable r;
+  r.fd = fd;
+  return r;
+}
+
+void Executor::Readable::await_suspend(std::coroutine_handle<> h) {
+  if (running == NULL) {
+    UDPPLUS_ERROR("co_await on a connection outside Executor::run");
+    exit(1);
+  }
+  running->wait(fd, h);
+}
+
+Executor::Yield Executor::yield() {
+  return Yield();
+}
+
+void Executor::Yield::await_suspend(std::coroutine_handle<> h) {
+  if (running == NULL) {
+    UDPPLUS_ERROR("co_await on a connection outside Executor::run");
+    exit(1);
+  }
+  running->ready.push_back(h);
+}
+
+void Executor::wait(int fd, std::coroutine_handle<> h) {
+  vector<std::coroutine_handle<> > &parked = waiters[fd];
+  parked.push_back(h);
+#ifdef __linux__
+  if (epollFd >= 0 && parked.size() == 1) {
+    // one shot, the descriptor stays registered but disarmed
+    // until a session waits on it again
+    struct epoll_event event;
+    event.events = EPOLLIN | EPOLLONESHOT;
+    event.data.fd = fd;
+    if (epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &event) < 0 &&
+        (errno != ENOENT || epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) < 0)) {
+      UDPPLUS_ERROR("epoll_ctl: %s", strerror(errno));
+      exit(1);
+    }
+  }
+#endif
+}
+
+void Executor::poll() {
+  vector<int> woken;
+#ifdef __linux__
+  if (epollFd >= 0) {
+    struct epoll_event events[64];
+    int count = epoll_wait(epollFd, events, 64, -1);
+    for (int i = 0; i < count; i++) {
+      woken.push_back(events[i].data.fd);
+    }
+  }
+#endif
+  if (epollFd < 0) {
+    vector<struct pollfd> fds;
+    for (std::map<int, vector<std::coroutine_handle<> > >::iterator i = waiters.begin(); i != waiters.end(); ++i) {
+      struct pollfd p;
+      p.fd = i->first;
+      p.events = POLLIN;
+      p.revents = 0;
+      fds.push_back(p);
+    }
+    if (::poll(&fds[0], fds.size(), -1) > 0) {
+      for (size_t i = 0; i < fds.size(); i++) {
+        if (fds[i].revents != 0) {
+          woken.push_back(fds[i].fd);
+        }
+      }
+    }
+  }
+  for (size_t i = 0; i < woken.size(); i++) {
+    std::map<int, vector<std::coroutine_handle<> > >::iterator found = waiters.find(woken[i]);
+    if (found == waiters.end()) {
+      continue;
+    }
+    ready.insert(ready.end(), found->second.begin(), found->second.end());
+    waiters.erase(found);
+  }
+}
+
+#endif
@@ -0,0 +1,87 @@
+/*
+ * Executor.h
+ *
+ *  Created on: Oct 16, 2026
+ *
+ *  The Executor class runs many UDP+ sessions on one thread.
+ *  Each session is a coroutine spawned as a Task; when one
+ *  awaits a connection that has nothing for it, the executor
+ *  parks it on the connection's event descriptor and runs the
+ *  next, so a server needs neither a thread nor a stack per
+ *  connection.  Waiting is done with epoll on Linux and poll
+ *  elsewhere.
+ *
+ *  Only available when UDPPLUS_COROUTINES is defined.
+ */
+
+//          Copyright Joe Coder 2004 - 2006.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+
+#ifndef EXECUTOR_H_
+#define EXECUTOR_H_
+
+#include "utility.h"
+#include "Task.h"
+
+#ifdef UDPPLUS_COROUTINES
+
+#include <map>
+
+class Executor : private boost::noncopyable {
+public:
+  Executor();
+  ~Executor();
+
+  // starts task on the next pass of run
+  // the executor owns it from then on, sessions still
+  // unfinished are destroyed with the executor
+  // an exception that ends the session is logged as a warning
+  // and dropped, the other sessions carry on
+  void spawn(Task<void> task);
+
+  // resumes sessions until every spawned task has finished
+  // returns early if every session waits and none can wake
+  void run();
+
+  // the executor running on this thread, NULL outside run
+  static Executor* current();
+
+  // suspends the awaiting session until fd is readable
+  // several sessions may wait on the same descriptor
+  struct Readable {
+    bool await_ready() noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> h);
+    void await_resume() noexcept {}
+    int fd;
+  };
+  static Readable readable(int fd);
+
+  // lets every other ready session run before continuing
+  struct Yield {
+    bool await_ready() noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> h);
+    void await_resume() noexcept {}
+  };
+  static Yield yield();
+
+private:
+  // parks h until fd is readable
+  void wait(int fd, std::coroutine_handle<> h);
+  // moves the sessions of descriptors that became readable
+  // to the ready queue, blocking until there is at least one
+  void poll();
+
+  int epollFd;    // -1 where epoll is not available
+  std::map<int, vector<std::coroutine_handle<> > > waiters;
+  deque<std::coroutine_handle<> > ready;
+  // frames of spawned tasks, freed once done
+  vector<Task<void>::Handle> roots;
+  int sessions;   // spawned tasks not yet finished
+};
+
+#endif
+
+#endif /* EXECUTOR_H_ */
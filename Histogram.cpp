@@ -0,0 +1,131 @@
+/*
+ * Histogram.cpp
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#include "Histogram.h"
+
+// the single writer has nothing to order against, relaxed
+// loads and stores avoid a locked instruction per record
+static void bump(boost::atomic<uint64_t> &counter, uint64_t amount) {
+  counter.store(counter.load(boost::memory_order_relaxed) + amount, boost::memory_order_relaxed);
+}
+
+Histogram::Histogram() {
+  for (int i = 0; i < BUCKETS; i++) {
+    buckets[i] = 0;
+  }
+  count = 0;
+  sum = 0;
+}
+
+Histogram::Histogram(const Histogram &other) {
+  *this = other;
+}
+
+Histogram& Histogram::operator=(const Histogram &other) {
+  for (int i = 0; i < BUCKETS; i++) {
+    buckets[i].store(other.buckets[i].load(boost::memory_order_relaxed), boost::memory_order_relaxed);
+  }
+  count.store(other.count.load(boost::memory_order_relaxed), boost::memory_order_relaxed);
+  sum.store(other.sum.load(boost::memory_order_relaxed), boost::memory_order_relaxed);
+  return *this;
+}
+
+void Histogram::record(time_duration value) {
+  int64_t micros = value.total_microseconds();
+  uint64_t v = (micros > 0) ? micros : 0;
+  int bucket = 0;
+  while (bucket < BUCKETS - 1 && (v >> bucket) != 0) {
+    bucket++;
+  }
+  bump(buckets[bucket], 1);
+  bump(count, 1);
+  bump(sum, v);
+}
+
+uint64_t Histogram::getCount() const {
+  return count.load(boost::memory_order_relaxed);
+}
+
+time_duration Histogram::getSum() const {
+  return microseconds(sum.load(boost::memory_order_relaxed));
+}
+
+uint64_t Histogram::getBucket(int bucket) const {
+  return buckets[bucket].load(boost::memory_order_relaxed);
+}
+
+time_duration Histogram::getBound(int bucket) {
+  if (bucket >= BUCKETS - 1) {
+    return pos_infin;
+  }
+  return microseconds((int64_t) 1 << bucket);
+}
+
+time_duration Histogram::percentile(double q) const {
+  uint64_t counts[BUCKETS];
+  uint64_t total = 0;
+  for (int i = 0; i < BUCKETS; i++) {
+    counts[i] = getBucket(i);
+    total += counts[i];
+  }
+  if (total == 0) {
+    return time_duration(0, 0, 0);
+  }
+  uint64_t rank = (uint64_t) ceil(q * total);
+  rank = (rank > 0) ? rank : 1;
+  uint64_t seen = 0;
+  for (int i = 0; i < BUCKETS - 1; i++) {
+    seen += counts[i];
+    if (seen >= rank) {
+      return getBound(i);
+    }
+  }
+  // beyond the last bound, report that bound
+  return getBound(BUCKETS - 2);
+}
+
+void Histogram::writeJson(ostream &out) const {
+  out << "{\"count\":" << getCount() << ",\"sum_us\":" << getSum().total_microseconds()
+      << ",\"p50_us\":" << percentile(0.5).total_microseconds()
+      << ",\"p99_us\":" << percentile(0.99).total_microseconds()
+      << ",\"p999_us\":" << percentile(0.999).total_microseconds() << ",\"buckets\":{";
+  bool first = true;
+  for (int i = 0; i < BUCKETS; i++) {
+    uint64_t n = getBucket(i);
+    if (n == 0) {
+      continue;
+    }
+    out << (first ? "" : ",") << "\"";
+    if (i < BUCKETS - 1) {
+      out << getBound(i).total_microseconds();
+    }
+    else {
+      out << "inf";
+    }
+    out << "\":" << n;
+    first = false;
+  }
+  out << "}}";
+}
+
+void Histogram::writePrometheus(ostream &out, const string &name, const string &labels) const {
+  string separator = labels.empty() ? "" : ",";
+  uint64_t cumulative = 0;
+  for (int i = 0; i < BUCKETS; i++) {
+    cumulative += getBucket(i);
+    out << name << "_bucket{" << labels << separator << "le=\"";
+    if (i < BUCKETS - 1) {
+      out << getBound(i).total_microseconds() / 1e6;
+    }
+    else {
+      out << "+Inf";
+    }
+    out << "\"} " << cumulative << "\n";
+  }
+  string braces = labels.empty() ? "" : "{" + labels + "}";
+  out << name << "_sum" << braces << " " << getSum().total_microseconds() / 1e6 << "\n";
+  out << name << "_count" << braces << " " << cumulative << "\n";
+}
@@ -0,0 +1,61 @@
+/*
+ * Histogram.h
+ *
+ *  Created on: Oct 16, 2026
+ *
+ *  The Histogram class counts durations in power of two
+ *  buckets of microseconds, bucket i holding those under 2^i.
+ *  Recording is a handful of relaxed atomic operations with no
+ *  lock, so one thread may record into it while others copy it
+ *  for a snapshot.  Only one thread may record at a time.
+ */
+
+//          Copyright Joe Coder 2004 - 2006.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+
+#ifndef HISTOGRAM_H_
+#define HISTOGRAM_H_
+
+#include "utility.h"
+
+#include <boost/atomic.hpp>
+
+using namespace boost::posix_time;
+
+class Histogram {
+public:
+  // the last bucket also holds everything longer, about 36 minutes
+  const static int BUCKETS = 32;
+
+  Histogram();
+  Histogram(const Histogram &other);
+  Histogram& operator=(const Histogram &other);
+
+  void record(time_duration value);
+
+  uint64_t getCount() const;
+  time_duration getSum() const;
+  uint64_t getBucket(int bucket) const;
+  // longest duration bucket counts, the last has no bound
+  static time_duration getBound(int bucket);
+  // bound of the bucket holding the q quantile, 0 <= q <= 1
+  // zero while nothing has been recorded
+  time_duration percentile(double q) const;
+
+  // an object with count, sum, p50, p99, p999 and the non-empty
+  // buckets, durations in microseconds
+  void writeJson(ostream &out) const;
+  // name_bucket, name_sum and name_count series, in seconds
+  // labels are added to every series, without braces
+  void writePrometheus(ostream &out, const string &name, const string &labels) const;
+
+private:
+  boost::atomic<uint64_t> buckets[BUCKETS];
+  boost::atomic<uint64_t> count;
+  boost::atomic<uint64_t> sum;  // microseconds
+};
+
+#endif /* HISTOGRAM_H_ */
@@ -0,0 +1,113 @@
+/*
+ * Logger.cpp
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#include "Logger.h"
+
+#include <stdarg.h>
+
+using namespace boost::posix_time;
+
+static const char *levelNames[] = { "TRACE", "DEBUG", "INFO", "WARN", "ERROR" };
+static const ptime epoch(boost::gregorian::date(1970, 1, 1));
+
+boost::atomic<int> Logger::minimum(Logger::INFO);
+
+Logger::Logger() {
+  queued = 0;
+  written = 0;
+  dropped = 0;
+  reported = 0;
+  output = stderr;
+  done = false;
+  drainer = boost::thread(&Logger::drain, this);
+}
+
+Logger& Logger::instance() {
+  static Logger *logger = NULL;
+  static boost::once_flag started = BOOST_ONCE_INIT;
+  struct Start {
+    static void run() {
+      logger = new Logger();
+      atexit(&Logger::stop);
+    }
+  };
+  boost::call_once(&Start::run, started);
+  return *logger;
+}
+
+void Logger::write(Level level, const char *format, ...) {
+  Record record;
+  record.micros = (microsec_clock::universal_time() - epoch).total_microseconds();
+  record.level = level;
+  va_list arguments;
+  va_start(arguments, format);
+  vsnprintf(record.text, TEXTSIZE, format, arguments);
+  va_end(arguments);
+
+  Logger &logger = instance();
+  if (!logger.ring.bounded_push(record)) {
+    logger.dropped.fetch_add(1, boost::memory_order_relaxed);
+    return;
+  }
+  logger.queued.fetch_add(1, boost::memory_order_release);
+}
+
+void Logger::setLevel(Level level) {
+  minimum.store(level, boost::memory_order_relaxed);
+}
+
+void Logger::setOutput(FILE *out) {
+  instance().output = out;
+}
+
+void Logger::flush() {
+  Logger &logger = instance();
+  uint64_t target = logger.queued.load(boost::memory_order_acquire);
+  while (logger.written.load(boost::memory_order_acquire) < target && !logger.done) {
+    boost::this_thread::sleep(milliseconds(1));
+  }
+}
+
+uint64_t Logger::getDropped() {
+  return instance().dropped.load(boost::memory_order_relaxed);
+}
+
+void Logger::stop() {
+  Logger &logger = instance();
+  logger.done = true;
+  logger.drainer.join();
+  // whatever raced the join
+  logger.writeQueued();
+}
+
+void Logger::drain() {
+  while (!done) {
+    if (writeQueued() == 0) {
+      boost::this_thread::sleep(milliseconds(10));
+    }
+  }
+}
+
+int Logger::writeQueued() {
+  FILE *out = output;
+  Record record;
+  int count = 0;
+  while (ring.pop(record)) {
+    string when = to_iso_extended_string(epoch + microseconds(record.micros));
+    fprintf(out, "%s %s %s\n", when.c_str(), levelNames[record.level], record.text);
+    count++;
+  }
+  uint64_t lost = dropped.load(boost::memory_order_relaxed);
+  if (lost != reported) {
+    fprintf(out, "logger: %llu messages dropped\n", (unsigned long long) (lost - reported));
+    reported = lost;
+  }
+  if (count > 0) {
+    fflush(out);
+    written.fetch_add(count, boost::memory_order_release);
+  }
+  return count;
+}
@@ -0,0 +1,105 @@
+/*
+ * Logger.h
+ *
+ *  Created on: Oct 16, 2026
+ *
+ *  The Logger class takes leveled diagnostics off the packet
+ *  path.  A message is formatted into a fixed-size record and
+ *  pushed onto a lock-free ring; a background thread drains
+ *  the ring to the output, so the thread that logs never waits
+ *  on terminal or file I/O.  When the ring is full messages
+ *  are dropped and counted rather than blocking.
+ *
+ *  Levels below UDPPLUS_LOG_LEVEL are compiled out by the
+ *  UDPPLUS_TRACE .. UDPPLUS_ERROR macros, arguments and all.
+ *  The rest are filtered again at run time by setLevel.
+ */
+
+//          Copyright Joe Coder 2004 - 2006.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+
+#ifndef LOGGER_H_
+#define LOGGER_H_
+
+#include "utility.h"
+
+#include <boost/atomic.hpp>
+#include <boost/lockfree/queue.hpp>
+
+// 0 trace, 1 debug, 2 info, 3 warn, 4 error, 5 nothing
+#ifndef UDPPLUS_LOG_LEVEL
+#define UDPPLUS_LOG_LEVEL 2
+#endif
+
+class Logger : private boost::noncopyable {
+public:
+  enum Level { TRACE, DEBUG, INFO, WARN, ERROR, OFF };
+
+  // longer messages are truncated
+  const static int TEXTSIZE = 120;
+  const static int CAPACITY = 4096;
+
+  // formats the message and queues it for the drain thread
+  // the first call starts that thread
+  static void write(Level level, const char *format, ...)
+      __attribute__((format(printf, 2, 3)));
+
+  static bool enabled(Level level) {
+    return level >= minimum.load(boost::memory_order_relaxed);
+  }
+  // messages below level are skipped, INFO by default
+  static void setLevel(Level level);
+  // stderr by default
+  static void setOutput(FILE *out);
+
+  // returns once every message queued before the call is written
+  static void flush();
+  // messages lost to a full ring
+  static uint64_t getDropped();
+
+private:
+  struct Record {
+    int64_t micros;   // since the epoch
+    int level;
+    char text[TEXTSIZE];
+  };
+
+  Logger();
+  // never destroyed, threads may still log during exit
+  static Logger& instance();
+  // stops the drain thread after writing what is queued
+  static void stop();
+
+  void drain();
+  // writes every queued record, returns how many
+  int writeQueued();
+
+  static boost::atomic<int> minimum;
+
+  boost::lockfree::queue<Record, boost::lockfree::capacity<CAPACITY> > ring;
+  boost::atomic<uint64_t> queued;
+  boost::atomic<uint64_t> written;
+  boost::atomic<uint64_t> dropped;
+  uint64_t reported;  // drops already written, drain thread only
+  boost::atomic<FILE*> output;
+  boost::atomic<bool> done;
+  boost::thread drainer;
+};
+
+#define UDPPLUS_LOG(level, ...) \
+  do { \
+    if ((level) >= UDPPLUS_LOG_LEVEL && Logger::enabled(level)) { \
+      Logger::write(level, __VA_ARGS__); \
+    } \
+  } while (0)
+
+#define UDPPLUS_TRACE(...) UDPPLUS_LOG(Logger::TRACE, __VA_ARGS__)
+#define UDPPLUS_DEBUG(...) UDPPLUS_LOG(Logger::DEBUG, __VA_ARGS__)
+#define UDPPLUS_INFO(...) UDPPLUS_LOG(Logger::INFO, __VA_ARGS__)
+#define UDPPLUS_WARN(...) UDPPLUS_LOG(Logger::WARN, __VA_ARGS__)
+#define UDPPLUS_ERROR(...) UDPPLUS_LOG(Logger::ERROR, __VA_ARGS__)
+
+#endif /* LOGGER_H_ */
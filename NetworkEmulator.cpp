@@ -0,0 +1,325 @@
+/*
+ * NetworkEmulator.cpp
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#include "NetworkEmulator.h"
+#include "ConnectionDemux.h"
+#include "UDPPlus.h"
+#include "UDPPlusConnection.h"
+
+// unbound endpoints are numbered from here, like ephemeral ports
+const uint16_t FIRSTPORT = 40000;
+
+Impairment::Impairment() : delay(0, 0, 0), jitter(0, 0, 0),
+    reorderDelay(milliseconds(1)), queueLimit(milliseconds(100)) {
+  loss = 0;
+  duplicate = 0;
+  reorder = 0;
+  bandwidth = 0;
+  mtu = 0;
+}
+
+EmulatorStats::EmulatorStats() {
+  sent = lost = overflowed = unreachable = 0;
+  duplicated = reordered = delivered = 0;
+}
+
+bool NetworkEmulator::Datagram::operator<(const Datagram &other) const {
+  if (arrival != other.arrival) {
+    return arrival > other.arrival;
+  }
+  return order > other.order;
+}
+
+NetworkEmulator::Link::Link(uint32_t seed) : generator(seed), nextFree(neg_infin),
+    lastArrival(neg_infin) {
+  impaired = false;
+}
+
+NetworkEmulator::NetworkEmulator(uint32_t seed) {
+  this->seed = seed;
+  nextPort = FIRSTPORT;
+  sequence = 0;
+  created = 0;
+}
+
+NetworkEmulator::~NetworkEmulator() {
+  if (created != 0) {
+    printf("network emulator destroyed with %d endpoints\n", created);
+    exit(1);
+  }
+  for (boost::unordered_map<uint64_t, Link*>::iterator i = links.begin(); i != links.end(); ++i) {
+    delete i->second;
+  }
+}
+
+DatagramTransport* NetworkEmulator::createTransport() {
+  boost::mutex::scoped_lock l(mutex);
+  created++;
+  return new Endpoint(this);
+}
+
+void NetworkEmulator::setImpairment(const Impairment &impairment) {
+  boost::mutex::scoped_lock l(mutex);
+  defaults = impairment;
+}
+
+void NetworkEmulator::setImpairment(const struct sockaddr *from, socklen_t length,
+    const Impairment &impairment) {
+  boost::mutex::scoped_lock l(mutex);
+  Link &link = getLink(ConnectionDemux::makeKey(from, length));
+  link.impaired = true;
+  link.impairment = impairment;
+}
+
+EmulatorStats NetworkEmulator::getStats() {
+  boost::mutex::scoped_lock l(mutex);
+  return stats;
+}
+
+double NetworkEmulator::draw(Link &link) {
+  return link.generator() / 4294967296.0;
+}
+
+NetworkEmulator::Link& NetworkEmulator::getLink(uint64_t key) {
+  Link *&link = links[key];
+  if (link == NULL) {
+    // each direction gets its own stream, independent of the
+    // order links happen to be created in
+    link = new Link(seed * 2654435761u ^ (uint32_t) (key ^ (key >> 32)));
+  }
+  return *link;
+}
+
+void NetworkEmulator::assignAddress(Endpoint *endpoint) {
+  memset(&endpoint->address, 0, sizeof(endpoint->address));
+  endpoint->address.sin_family = AF_INET;
+  inet_pton(AF_INET, "127.0.0.1", &endpoint->address.sin_addr);
+  uint64_t key;
+  do {
+    endpoint->address.sin_port = htons(nextPort);
+    nextPort = (nextPort == 65535) ? FIRSTPORT : nextPort + 1;
+    key = ConnectionDemux::makeKey((struct sockaddr *) &endpoint->address, sizeof(endpoint->address));
+  } while (endpoints.find(key) != endpoints.end());
+  endpoints[key] = endpoint;
+  endpoint->bound = true;
+}
+
+int NetworkEmulator::transmit(Endpoint *from, const struct sockaddr *to, socklen_t toLength,
+    const struct iovec *iov, int iovcnt) {
+  Link &link = getLink(ConnectionDemux::makeKey((struct sockaddr *) &from->address, sizeof(from->address)));
+  const Impairment &impairment = link.impaired ? link.impairment : defaults;
+  size_t length = 0;
+  for (int i = 0; i < iovcnt; i++) {
+    length += iov[i].iov_len;
+  }
+  if (impairment.mtu > 0 && length > impairment.mtu) {
+    errno = EMSGSIZE;
+    return -1;
+  }
+  stats.sent++;
+  if (draw(link) < impairment.loss) {
+    stats.lost++;
+    return 0;
+  }
+
+  ptime now = microsec_clock::universal_time();
+  ptime departure = now;
+  if (impairment.bandwidth > 0) {
+    ptime start = (link.nextFree > now) ? link.nextFree : now;
+    if (start - now > impairment.queueLimit) {
+      stats.overflowed++;
+      return 0;
+    }
+    departure = start + microseconds((int64_t) (length * 1000000.0 / impairment.bandwidth));
+    link.nextFree = departure;
+  }
+
+  boost::unordered_map<uint64_t, Endpoint*>::iterator found =
+      endpoints.find(ConnectionDemux::makeKey(to, toLength));
+  if (found == endpoints.end()) {
+    stats.unreachable++;
+    return 0;
+  }
+  vector<char> data(length);
+  size_t offset = 0;
+  for (int i = 0; i < iovcnt; i++) {
+    memcpy(&data[offset], iov[i].iov_base, iov[i].iov_len);
+    offset += iov[i].iov_len;
+  }
+
+  int copies = 1;
+  if (draw(link) < impairment.duplicate) {
+    stats.duplicated++;
+    copies = 2;
+  }
+  for (int c = 0; c < copies; c++) {
+    ptime arrival = departure + impairment.delay;
+    if (impairment.jitter.total_microseconds() > 0) {
+      arrival += microseconds((int64_t) (draw(link) * impairment.jitter.total_microseconds()));
+    }
+    if (draw(link) < impairment.reorder) {
+      stats.reordered++;
+      arrival += impairment.reorderDelay;
+    }
+    else {
+      // jitter spreads arrivals out but a link keeps them in order,
+      // only reorder overtakes
+      arrival = (arrival > link.lastArrival) ? arrival : link.lastArrival;
+      link.lastArrival = arrival;
+    }
+    deliver(found->second, from, data, arrival);
+  }
+  return 0;
+}
+
+void NetworkEmulator::deliver(Endpoint *to, Endpoint *from, const vector<char> &data, ptime arrival) {
+  stats.delivered++;
+  Datagram datagram;
+  datagram.arrival = arrival;
+  datagram.order = sequence++;
+  memcpy(&datagram.from, &from->address, sizeof(from->address));
+  datagram.fromLength = sizeof(from->address);
+  datagram.data = data;
+  boost::mutex::scoped_lock l(to->mutex);
+  to->inbox.push(datagram);
+  to->arrived.notify_one();
+}
+
+NetworkEmulator::Endpoint::Endpoint(NetworkEmulator *network) {
+  this->network = network;
+  bound = false;
+  closed = false;
+  memset(&address, 0, sizeof(address));
+}
+
+NetworkEmulator::Endpoint::~Endpoint() {
+  boost::mutex::scoped_lock l(network->mutex);
+  if (bound) {
+    network->endpoints.erase(ConnectionDemux::makeKey((struct sockaddr *) &address, sizeof(address)));
+  }
+  network->created--;
+}
+
+int NetworkEmulator::Endpoint::bind(const struct sockaddr *address, socklen_t length) {
+  boost::mutex::scoped_lock l(network->mutex);
+  if (bound || address->sa_family != AF_INET || length < (socklen_t) sizeof(this->address)) {
+    errno = EINVAL;
+    return -1;
+  }
+  const struct sockaddr_in *requested = (const struct sockaddr_in *) address;
+  if (requested->sin_port == 0) {
+    network->assignAddress(this);
+    return 0;
+  }
+  uint64_t key = ConnectionDemux::makeKey(address, length);
+  if (network->endpoints.find(key) != network->endpoints.end()) {
+    errno = EADDRINUSE;
+    return -1;
+  }
+  memcpy(&this->address, requested, sizeof(this->address));
+  network->endpoints[key] = this;
+  bound = true;
+  return 0;
+}
+
+int NetworkEmulator::Endpoint::send(const struct sockaddr *to, socklen_t toLength,
+    const struct iovec *iov, int iovcnt) {
+  boost::mutex::scoped_lock l(network->mutex);
+  if (!bound) {
+    network->assignAddress(this);
+  }
+  return network->transmit(this, to, toLength, iov, iovcnt);
+}
+
+int NetworkEmulator::Endpoint::receive(DatagramBatch &batch) {
+  boost::mutex::scoped_lock l(mutex);
+  batch.clear();
+  while (batch.empty()) {
+    if (closed) {
+      return -1;
+    }
+    if (inbox.empty()) {
+      arrived.wait(l);
+      continue;
+    }
+    ptime now = microsec_clock::universal_time();
+    ptime due = inbox.top().arrival;
+    if (due > now) {
+      arrived.timed_wait(l, due);
+      continue;
+    }
+    while (!inbox.empty() && inbox.top().arrival <= now && !batch.full()) {
+      const Datagram &datagram = inbox.top();
+      // one longer than the receive buffer is dropped
+      if (!datagram.data.empty()) {
+        batch.add(&datagram.from, datagram.fromLength, &datagram.data[0], datagram.data.size());
+      }
+      inbox.pop();
+    }
+  }
+  return batch.size();
+}
+
+void NetworkEmulator::Endpoint::close() {
+  boost::mutex::scoped_lock l(mutex);
+  closed = true;
+  arrived.notify_all();
+}
+
+EmulatedPair::EmulatedPair(NetworkEmulator &network, int port, int serverBuffer,
+    int clientBuffer, int serverConnections) : network(network) {
+  this->clientBuffer = clientBuffer;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  inet_pton(AF_INET, "10.0.0.1", &address.sin_addr);
+
+  server = new UDPPlus(serverConnections, serverBuffer);
+  server->setTransport(network.createTransport());
+  server->bind_p((struct sockaddr *) &address, sizeof(address));
+  client = new UDPPlus(1, clientBuffer);
+  client->setTransport(network.createTransport());
+  outgoing = NULL;
+  incoming = NULL;
+}
+
+EmulatedPair::~EmulatedPair() {
+  if (outgoing != NULL) {
+    outgoing->closeConnection();
+  }
+  if (incoming != NULL) {
+    incoming->closeConnection();
+  }
+  delete outgoing;
+  delete incoming;
+  for (size_t i = 0; i < others.size(); i++) {
+    delete othersOutgoing[i];
+    delete others[i];
+  }
+  delete client;
+  delete server;
+}
+
+bool EmulatedPair::open() {
+  if (connect() == NULL) {
+    return false;
+  }
+  incoming = server->accept_p();
+  return incoming != NULL;
+}
+
+UDPPlusConnection* EmulatedPair::connect() {
+  outgoing = client->conn((struct sockaddr *) &address, sizeof(address));
+  return outgoing;
+}
+
+UDPPlusConnection* EmulatedPair::connectAnother() {
+  UDPPlus *other = new UDPPlus(1, clientBuffer);
+  other->setTransport(network.createTransport());
+  others.push_back(other);
+  othersOutgoing.push_back(other->conn((struct sockaddr *) &address, sizeof(address)));
+  return othersOutgoing.back();
+}
@@ -0,0 +1,200 @@
+/*
+ * NetworkEmulator.h
+ *
+ *  Created on: Oct 16, 2026
+ *
+ *  The NetworkEmulator class is an in-memory IPv4 network
+ *  for UDPPlus objects in one process.  Each UDPPlus is given
+ *  an Endpoint from createTransport; datagrams sent between
+ *  endpoints pass through a link that can lose, duplicate,
+ *  reorder, delay and rate limit them.
+ *
+ *  Every link draws from its own random generator seeded from
+ *  the network's seed and the sender's address, so a run that
+ *  sends the same datagrams in the same order sees the same
+ *  impairments.  Delivery is timed: a datagram waits in the
+ *  receiver's queue until its arrival time, with no thread
+ *  of the emulator's own.
+ *
+ *  An EmulatedPair sets up what most tests need: a server and
+ *  a client on one network, connected to each other.
+ */
+
+//          Copyright Joe Coder 2004 - 2006.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+
+#ifndef NETWORKEMULATOR_H_
+#define NETWORKEMULATOR_H_
+
+#include "utility.h"
+#include "DatagramTransport.h"
+
+#include <queue>
+#include <boost/unordered_map.hpp>
+#include <boost/random/mersenne_twister.hpp>
+
+using namespace boost::posix_time;
+
+// what a link does to the datagrams crossing it
+struct Impairment {
+  // a clean link, delivered at once
+  Impairment();
+
+  double loss;          // probability a datagram is dropped
+  double duplicate;     // probability a second copy is delivered
+  double reorder;       // probability a datagram is held back by reorderDelay
+  time_duration delay;  // one-way propagation delay
+  time_duration jitter; // uniform extra delay, 0 to jitter, order kept
+  time_duration reorderDelay;
+  double bandwidth;     // bytes per second, 0 for unlimited
+  // longest a datagram may wait behind the bandwidth limit
+  // before it is tail dropped
+  time_duration queueLimit;
+  size_t mtu;           // longer datagrams fail with EMSGSIZE, 0 for no limit
+};
+
+// counts over every link
+struct EmulatorStats {
+  EmulatorStats();
+
+  uint64_t sent;
+  uint64_t lost;        // dropped by the loss probability
+  uint64_t overflowed;  // dropped by the queue limit
+  uint64_t unreachable; // sent to an address nobody has bound
+  uint64_t duplicated;
+  uint64_t reordered;
+  uint64_t delivered;   // copies queued for a receiver
+};
+
+class NetworkEmulator : private boost::noncopyable {
+public:
+  // seed fixes every random draw the links make
+  NetworkEmulator(uint32_t seed = 1);
+  // every endpoint must have been destroyed first
+  ~NetworkEmulator();
+
+  // a new endpoint, to be handed to UDPPlus::setTransport
+  DatagramTransport* createTransport();
+
+  // applies to every link without one of its own
+  void setImpairment(const Impairment &impairment);
+  // applies to datagrams sent from the given address
+  void setImpairment(const struct sockaddr *from, socklen_t length,
+      const Impairment &impairment);
+
+  EmulatorStats getStats();
+
+private:
+  struct Datagram {
+    ptime arrival;
+    uint64_t order;   // ties keep send order
+    struct sockaddr from;
+    socklen_t fromLength;
+    vector<char> data;
+
+    // the earliest arrival on top of the priority queue
+    bool operator<(const Datagram &other) const;
+  };
+
+  class Endpoint : public DatagramTransport {
+  public:
+    Endpoint(NetworkEmulator *network);
+    ~Endpoint();
+
+    int bind(const struct sockaddr *address, socklen_t length);
+    int send(const struct sockaddr *to, socklen_t toLength,
+        const struct iovec *iov, int iovcnt);
+    int receive(DatagramBatch &batch);
+    void close();
+
+  private:
+    friend class NetworkEmulator;
+
+    NetworkEmulator *network;
+    bool bound;
+    struct sockaddr_in address;
+    // guards inbox and closed, lock after the network's mutex
+    boost::mutex mutex;
+    boost::condition_variable arrived;
+    std::priority_queue<Datagram> inbox;
+    bool closed;
+  };
+
+  // the direction of traffic leaving one address
+  struct Link {
+    Link(uint32_t seed);
+
+    boost::random::mt19937 generator;
+    bool impaired;            // has an impairment of its own
+    Impairment impairment;
+    ptime nextFree;           // when the bandwidth limit frees up
+    ptime lastArrival;        // of the last datagram kept in order
+  };
+
+  // a uniform draw in [0, 1) from the link's generator
+  static double draw(Link &link);
+  // finds or creates the link for datagrams sent from key
+  Link& getLink(uint64_t key);
+  // gives an endpoint the next free loopback port
+  void assignAddress(Endpoint *endpoint);
+  // queues a datagram for every copy the link delivers
+  // expects mutex to be held
+  int transmit(Endpoint *from, const struct sockaddr *to, socklen_t toLength,
+      const struct iovec *iov, int iovcnt);
+  // puts one copy in the receiver's inbox
+  void deliver(Endpoint *to, Endpoint *from, const vector<char> &data, ptime arrival);
+
+  uint32_t seed;
+  // guards everything below
+  boost::mutex mutex;
+  boost::unordered_map<uint64_t, Endpoint*> endpoints;
+  boost::unordered_map<uint64_t, Link*> links;
+  Impairment defaults;
+  uint16_t nextPort;
+  uint64_t sequence;
+  int created;
+  EmulatorStats stats;
+};
+
+class UDPPlus;
+class UDPPlusConnection;
+
+// a server bound at 10.0.0.1 and a client, each a UDPPlus on
+// an endpoint of one network, for the tests and benchmarks.
+// Declared after the network so it is destroyed first
+class EmulatedPair : private boost::noncopyable {
+public:
+  // binds the server to port, its connections get serverBuffer
+  // packets and the client's clientBuffer
+  EmulatedPair(NetworkEmulator &network, int port, int serverBuffer = 256,
+      int clientBuffer = 256, int serverConnections = 1);
+  // closes both ends and deletes every object below
+  ~EmulatedPair();
+
+  // connects the client and takes the connection with accept_p,
+  // false if either fails
+  bool open();
+  // connects the client only, for a test that accepts itself
+  UDPPlusConnection* connect();
+  // connects one more client to the server, deleted with the pair
+  UDPPlusConnection* connectAnother();
+
+  struct sockaddr_in address;
+  UDPPlus *server;
+  // not yet connected, settings go on it before open
+  UDPPlus *client;
+  UDPPlusConnection *outgoing;
+  // NULL until open
+  UDPPlusConnection *incoming;
+
+private:
+  NetworkEmulator &network;
+  int clientBuffer;
+  vector<UDPPlus*> others;
+  vector<UDPPlusConnection*> othersOutgoing;
+};
+
+#endif /* NETWORKEMULATOR_H_ */
@@ -0,0 +1,33 @@
+/*
+ * NewReno.cpp
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#include "NewReno.h"
+
+NewReno::NewReno() {
+}
+
+const char* NewReno::getName() {
+  return "newreno";
+}
+
+void NewReno::handleAck(int acked, time_duration rtt) {
+  if (inSlowStart()) {
+    cwnd += acked;
+  }
+  else {
+    cwnd += (double) acked / cwnd;
+  }
+}
+
+void NewReno::handleLoss(int inFlight) {
+  ssthresh = (inFlight / 2 > MINIMUMWINDOW) ? inFlight / 2 : MINIMUMWINDOW;
+  cwnd = ssthresh;
+}
+
+void NewReno::handleTimeout(int inFlight) {
+  ssthresh = (inFlight / 2 > MINIMUMWINDOW) ? inFlight / 2 : MINIMUMWINDOW;
+  cwnd = 1;
+}
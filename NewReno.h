@@ -0,0 +1,34 @@
+/*
+ * NewReno.h
+ *
+ *  Created on: Oct 16, 2026
+ *
+ *  The NewReno class is the standard TCP congestion control
+ *  of RFC 5681 and RFC 6582: slow start, additive increase of
+ *  one packet per round trip, and halving the window on loss.
+ */
+
+//          Copyright Joe Coder 2004 - 2006.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+
+#ifndef NEWRENO_H_
+#define NEWRENO_H_
+
+#include "CongestionControl.h"
+
+class NewReno : public CongestionControl {
+public:
+  NewReno();
+
+  virtual const char* getName();
+
+protected:
+  virtual void handleAck(int acked, time_duration rtt);
+  virtual void handleLoss(int inFlight);
+  virtual void handleTimeout(int inFlight);
+};
+
+#endif /* NEWRENO_H_ */
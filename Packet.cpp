@@ -7,43 +7,145 @@
 
 #include "Packet.h"
 #include "utility.h"
+#include "Logger.h"
+
+#include <boost/lockfree/stack.hpp>
+
+// packet objects kept for reuse by operator new
+// bounded_push never allocates, so once this many packets are
+// cached any further ones are handed back to the heap
+const static int CACHEDPACKETS = 4096;
+
+static boost::lockfree::stack<void*>& packetFreeList() {
+  static boost::lockfree::stack<void*> freeList(CACHEDPACKETS);
+  return freeList;
+}
+
+void* Packet::operator new(size_t size) {
+  void *p;
+  if (size == sizeof(Packet) && packetFreeList().pop(p)) {
+    return p;
+  }
+  return ::operator new(size);
+}
+
+void Packet::operator delete(void *p) {
+  if (p != NULL && !packetFreeList().bounded_push(p)) {
+    ::operator delete(p);
+  }
+}
+
+Packet::Packet() {
+  sendCount = 0;
+  buffer = NULL;
+  length = 0;
+  capacity = 0;
+  pool = NULL;
+  segments = NULL;
+  segmentCount = 0;
+  segmentLength = 0;
+}
+
+Packet* Packet::adopt(PacketPool *pool, char *slab, size_t length) {
+  Packet *packet = new Packet();
+  packet->pool = pool;
+  packet->buffer = slab;
+  packet->length = length;
+  packet->capacity = pool->getSlabSize();
+  return packet;
+}
+
+Packet* Packet::scatter(PacketPool *pool, uint8_t field, uint32_t seqNumber, uint32_t ackNumber,
+    const struct iovec *segments, int segmentCount, boost::function<void()> onRelease) {
+  Packet *packet = new Packet();
+  packet->pool = pool;
+  packet->build(field, seqNumber, ackNumber, 0, 0, 0, 0);
+  packet->segments = new struct iovec[segmentCount];
+  packet->segmentCount = segmentCount;
+  for (int i = 0; i < segmentCount; i++) {
+    packet->segments[i] = segments[i];
+    packet->segmentLength += segments[i].iov_len;
+  }
+  packet->onRelease = onRelease;
+  return packet;
+}
 
 Packet::Packet(const void *buffer, size_t length) {
-  this->length = length;
-  this->buffer = new char[length];
+  pool = NULL;
+  allocate(length);
+  memcpy(this->buffer, buffer, length);
+}
+
+Packet::Packet(PacketPool *pool, const void *buffer, size_t length) {
+  this->pool = pool;
+  allocate(length);
   memcpy(this->buffer, buffer, length);
 }
 
 Packet::Packet(const Packet &original) {
-  numAck = original.numAck;
   sendCount = original.sendCount;
-  buffer = new char[original.length];
-  length = original.length;
-  memcpy(buffer, original.buffer, length);
+  sendingTime = original.sendingTime;
+  pool = original.pool;
+  // a copy never borrows the original's segments, they are
+  // gathered into the copy's own buffer
+  allocate(original.length + original.segmentLength);
+  memcpy(buffer, original.buffer, original.length);
+  size_t offset = original.length;
+  for (int i = 0; i < original.segmentCount; i++) {
+    memcpy(buffer + offset, original.segments[i].iov_base, original.segments[i].iov_len);
+    offset += original.segments[i].iov_len;
+  }
+}
+
+
+Packet::Packet(uint8_t field, uint32_t seqNumber, uint32_t ackNumber, const void *firstBuffer,
+    size_t firstBufferLength, const void *secondBuffer, size_t secondBufferLength)
+{
+  pool = NULL;
+  build(field, seqNumber, ackNumber, firstBuffer, firstBufferLength, secondBuffer, secondBufferLength);
 }
 
+Packet::Packet(PacketPool *pool, uint8_t field, uint32_t seqNumber, uint32_t ackNumber, const void *firstBuffer,
+    size_t firstBufferLength, const void *secondBuffer, size_t secondBufferLength)
+{
+  this->pool = pool;
+  build(field, seqNumber, ackNumber, firstBuffer, firstBufferLength, secondBuffer, secondBufferLength);
+}
 
-Packet::Packet(uint8_t field, uint16_t seqNumber, uint16_t ackNumber, const void *firstBuffer,
+void Packet::allocate(size_t length) {
+  segments = NULL;
+  segmentCount = 0;
+  segmentLength = 0;
+  this->length = length;
+  capacity = length;
+  buffer = (pool != NULL) ? pool->allocate(length) : NULL;
+  if (buffer == NULL) {
+    pool = NULL;
+    buffer = new char[length];
+  }
+}
+
+void Packet::build(uint8_t field, uint32_t seqNumber, uint32_t ackNumber, const void *firstBuffer,
     size_t firstBufferLength, const void *secondBuffer, size_t secondBufferLength)
 {
   sendCount = 0;
-  numAck = 0;
-  buffer = new char[DEFAULTHEADERSIZE + firstBufferLength + secondBufferLength];
-  length = DEFAULTHEADERSIZE + firstBufferLength + secondBufferLength;
+  unsigned headerSize = (field & EXT) ? EXTHEADERSIZE : DEFAULTHEADERSIZE;
+  allocate(headerSize + firstBufferLength + secondBufferLength);
 
-  clear();
+  memset(buffer, 0, length);
   setField(field);
+  setHeaderLength(headerSize);
   setSeqNumber(seqNumber);
   setAckNumber(ackNumber, getField(ACK));
   if ( getField(OPT) ) {
-    setHeaderLength(DEFAULTHEADERSIZE + firstBufferLength);
+    setHeaderLength(headerSize + firstBufferLength);
   }
 
   if ( firstBuffer != NULL ) {
-    memcpy(buffer + DEFAULTHEADERSIZE, firstBuffer, firstBufferLength);
+    memcpy(buffer + headerSize, firstBuffer, firstBufferLength);
   }
   if (secondBuffer != NULL) {
-    memcpy(buffer + DEFAULTHEADERSIZE + firstBufferLength, secondBuffer, secondBufferLength);
+    memcpy(buffer + headerSize + firstBufferLength, secondBuffer, secondBufferLength);
   }
 
 }
@@ -53,13 +155,31 @@ void Packet::insert_uint16_t(uint16_t number, void *location) {
   memcpy(location, &number, sizeof(uint16_t));
 }
 
+void Packet::insert_uint32_t(uint32_t number, void *location) {
+  number = htonl(number);
+  memcpy(location, &number, sizeof(uint32_t));
+}
+
 Packet::~Packet() {
-  delete buffer;
+  if (segments != NULL) {
+    delete[] segments;
+    if (onRelease) {
+      onRelease();
+    }
+  }
+  if (pool != NULL) {
+    pool->release(buffer, capacity);
+  }
+  else {
+    delete[] buffer;
+  }
 }
 
 void Packet::clear() {
+  bool extended = getField(EXT);
   memset(buffer, 0, length);
-  buffer[1] = DEFAULTHEADERSIZE;
+  setField(EXT, extended);
+  buffer[1] = getBaseHeaderLength();
 }
 
 bool Packet::getField(uint8_t field) {
@@ -75,38 +195,82 @@ void Packet::setField(uint8_t field, bool value) {
   }
 }
 
-uint16_t Packet::getSeqNumber() {
+uint32_t Packet::getSeqNumber() {
+  if (getField(EXT)) {
+    uint32_t seqNumber;
+    memcpy(&seqNumber, buffer + EXTSEQLOCATION, sizeof(uint32_t));
+    return( ntohl(seqNumber) );
+  }
   uint16_t seqNumber;
   memcpy(&seqNumber, buffer + SEQLOCATION, sizeof(uint16_t));
   return( ntohs(seqNumber) );
 }
 
-uint16_t Packet::getAckNumber() {
+uint32_t Packet::getAckNumber() {
+  if (getField(EXT)) {
+    uint32_t ackNumber;
+    memcpy(&ackNumber, buffer + EXTACKLOCATION, sizeof(uint32_t));
+    return( ntohl(ackNumber) );
+  }
   uint16_t ackNumber;
   memcpy(&ackNumber, buffer + ACKLOCATION, sizeof(uint16_t));
   return( ntohs(ackNumber) );
 }
 
-void Packet::setSeqNumber(uint16_t seqNumber, bool shouldSet) {
+void Packet::setSeqNumber(uint32_t seqNumber, bool shouldSet) {
   if (shouldSet) {
-    insert_uint16_t(seqNumber, buffer + SEQLOCATION);
+    if (getField(EXT)) {
+      insert_uint32_t(seqNumber, buffer + EXTSEQLOCATION);
+    }
+    else {
+      insert_uint16_t(seqNumber, buffer + SEQLOCATION);
+    }
   }
 }
 
-void Packet::setAckNumber(uint16_t ackNumber, bool shouldSet) {
+void Packet::setAckNumber(uint32_t ackNumber, bool shouldSet) {
   if (shouldSet) {
     setField(ACK);
-    insert_uint16_t(ackNumber, buffer + ACKLOCATION);
+    if (getField(EXT)) {
+      insert_uint32_t(ackNumber, buffer + EXTACKLOCATION);
+    }
+    else {
+      insert_uint16_t(ackNumber, buffer + ACKLOCATION);
+    }
+  }
+}
+
+uint16_t Packet::getWindow() {
+  if (!getField(EXT)) {
+    return 0;
+  }
+  uint16_t window;
+  memcpy(&window, buffer + WINDOWLOCATION, sizeof(uint16_t));
+  return( ntohs(window) );
+}
+
+void Packet::setWindow(uint16_t window) {
+  if (getField(EXT)) {
+    insert_uint16_t(window, buffer + WINDOWLOCATION);
   }
 }
 
+unsigned Packet::getBaseHeaderLength() {
+  return getField(EXT) ? EXTHEADERSIZE : DEFAULTHEADERSIZE;
+}
+
+bool Packet::isValid() {
+  return length >= DEFAULTHEADERSIZE && length >= getBaseHeaderLength() &&
+      getHeaderLength() >= getBaseHeaderLength() && getHeaderLength() <= length;
+}
+
 size_t Packet::getOptField(void *optBuffer, size_t optBufferLength) {
-  size_t optLength = getHeaderLength() - DEFAULTHEADERSIZE;
+  size_t optLength = getHeaderLength() - getBaseHeaderLength();
 
   if (optLength > optBufferLength)
     optLength = optBufferLength;
 
-  memcpy(optBuffer, buffer + DEFAULTHEADERSIZE, optLength );
+  memcpy(optBuffer, buffer + getBaseHeaderLength(), optLength );
 
   return optLength;
 }
@@ -129,11 +293,28 @@ size_t Packet::getData(void *outBuffer, size_t outBufferLength) {
     dataLength = outBufferLength;
 
   memcpy(outBuffer, (buffer + headerLength), dataLength);
+
+  for (int i = 0; i < segmentCount && dataLength < outBufferLength; i++) {
+    size_t segment = segments[i].iov_len;
+    if (segment > outBufferLength - dataLength)
+      segment = outBufferLength - dataLength;
+    memcpy((char *) outBuffer + dataLength, segments[i].iov_base, segment);
+    dataLength += segment;
+  }
   return dataLength;
 }
 
+const char* Packet::getPayload() {
+  return buffer + getHeaderLength();
+}
+
+size_t Packet::getPayloadLength() {
+  size_t headerLength = getHeaderLength();
+  return ((length > headerLength) ? length - headerLength : 0) + segmentLength;
+}
+
 size_t Packet::getLength() {
-  return length;
+  return length + segmentLength;
 }
 
 void Packet::updateTime() {
@@ -148,9 +329,29 @@ char* Packet::getBuffer() {
   return buffer;
 }
 
+size_t Packet::getBufferLength() {
+  return length;
+}
+
+bool Packet::isScattered() {
+  return segmentCount > 0;
+}
+
+int Packet::getSegments(struct iovec *vectors, int maxVectors) {
+  if (maxVectors < 1) {
+    return 0;
+  }
+  vectors[0].iov_base = buffer;
+  vectors[0].iov_len = length;
+  int count = 1;
+  for (int i = 0; i < segmentCount && count < maxVectors; i++) {
+    vectors[count++] = segments[i];
+  }
+  return count;
+}
+
 void Packet::print() {
-  char buf[2048];
-  //cout << "-----Sequence#:" << getSeqNumber() << " Acknowledgment#:" << getAckNumber() << "------" << endl;
-  //cout << "\t\tDATA:" << getField(DATA) << " ACK:" << getField(ACK) << " SYN:" << getField(SYN) << " FIN:" << getField(FIN) << " OPT:" << getField(OPT) << endl;
-  if (getField(DATA)) { getData(buf, sizeof(buf)); buf; }
+  UDPPLUS_TRACE("seq %u ack %u DATA:%d ACK:%d SYN:%d FIN:%d OPT:%d length %d",
+      getSeqNumber(), getAckNumber(), getField(DATA), getField(ACK), getField(SYN),
+      getField(FIN), getField(OPT), (int) getLength());
 }
@@ -21,6 +21,10 @@
 #define PACKET_H_
 
 #include "utility.h"
+#include "PacketPool.h"
+
+#include <sys/uio.h>
+#include <boost/function.hpp>
 
 using namespace boost::posix_time;
 
@@ -34,27 +38,80 @@ public:
   const static uint8_t SYN = 0x20;
   const static uint8_t FIN = 0x10;
   const static uint8_t OPT = 0x08;
+  // extended header, 32 bit sequence and ack numbers
+  // negotiated in the SYN and SYN-ACK
+  const static uint8_t EXT = 0x04;
+  // the payload is a run of coalesced messages, each a 16 bit
+  // length followed by that many bytes
+  const static uint8_t MSG = 0x02;
+  const static unsigned FRAMEHEADERSIZE = 2;
+  // the packet is a fragment of a message too big for one
+  // datagram.  The first fragment also carries MSG and its
+  // payload starts with the message's 32 bit length
+  const static uint8_t FRAG = 0x01;
+  const static unsigned FRAGHEADERSIZE = 4;
+  // without DATA, MSG marks a path MTU probe, padded to the size
+  // being tried, and FRAG the answer, carrying the 16 bit length
+  // the probe arrived with
+  const static uint8_t PROBE = MSG;
+  const static uint8_t PROBEREPLY = FRAG;
+  const static unsigned PROBEREPLYSIZE = 2;
 
   const static int SEQLOCATION = 2;
   const static int ACKLOCATION = 4;
+  const static unsigned EXTHEADERSIZE = 12;
+  const static int EXTSEQLOCATION = 2;
+  const static int EXTACKLOCATION = 6;
+  const static int WINDOWLOCATION = 10;
 
-  int numAck;
   int sendCount;
 
   Packet(const Packet&);
   Packet(const void *buffer, size_t length);
-  Packet(uint8_t field, uint16_t seqNumber, uint16_t ackNumber, const void *firstBuffer = 0,
+  Packet(uint8_t field, uint32_t seqNumber, uint32_t ackNumber, const void *firstBuffer = 0,
+      size_t firstBufferLength = 0, const void *secondBuffer = 0, size_t secondBufferLength = 0);
+
+  // same as above, but the buffer is drawn from pool
+  // the pool must outlive the packet
+  Packet(PacketPool *pool, const void *buffer, size_t length);
+  Packet(PacketPool *pool, uint8_t field, uint32_t seqNumber, uint32_t ackNumber, const void *firstBuffer = 0,
       size_t firstBufferLength = 0, const void *secondBuffer = 0, size_t secondBufferLength = 0);
   ~Packet();
 
+  // builds a packet around a slab that already holds a datagram
+  // the packet takes over the slab and returns it to pool
+  static Packet* adopt(PacketPool *pool, char *slab, size_t length);
+
+  // builds a packet whose payload stays in the caller's segments
+  // only the header is stored in the packet, the segments are
+  // referenced until the packet is destroyed, then onRelease runs
+  static Packet* scatter(PacketPool *pool, uint8_t field, uint32_t seqNumber, uint32_t ackNumber,
+      const struct iovec *segments, int segmentCount, boost::function<void()> onRelease);
+
+  // packet objects are recycled through a free list
+  // instead of going back to the heap
+  static void* operator new(size_t size);
+  static void operator delete(void *p);
+
   void print();
   void insert_uint16_t(uint16_t number, void *location);
+  void insert_uint32_t(uint32_t number, void *location);
   bool getField(uint8_t field);
   void setField(uint8_t field, bool value=true);
-  uint16_t getSeqNumber();
-  uint16_t getAckNumber();
-  void setSeqNumber(uint16_t seqNumber, bool shouldSet=true);
-  void setAckNumber(uint16_t ackNumber, bool shouldSet=true);
+  // 16 bits wide unless the EXT flag is set
+  uint32_t getSeqNumber();
+  uint32_t getAckNumber();
+  void setSeqNumber(uint32_t seqNumber, bool shouldSet=true);
+  void setAckNumber(uint32_t ackNumber, bool shouldSet=true);
+  // advertised receive window, shifted right by the sender's
+  // window scale, only the extended header carries one
+  uint16_t getWindow();
+  void setWindow(uint16_t window);
+
+  // size of the fixed header, before any optional field
+  unsigned getBaseHeaderLength();
+  // false if the datagram is too short for the header it claims
+  bool isValid();
 
 
   size_t getOptField(void *optBuffer, size_t optBufferLength);
@@ -65,17 +122,45 @@ public:
   void setHeaderLength(uint8_t headerLength);
 
   size_t getData(void *outBuffer, size_t outBufferLength);
+  // payload in place, valid for the life of the packet
+  // not available for scattered packets
+  const char* getPayload();
+  size_t getPayloadLength();
+  // length of the whole datagram, header and payload
   size_t getLength();
   void updateTime();
   ptime getTime();
 
+  // header, and payload unless the packet is scattered
   char* getBuffer();
+  size_t getBufferLength();
+
+  bool isScattered();
+  // fills vectors with the header followed by the payload segments
+  // returns the number of vectors used
+  int getSegments(struct iovec *vectors, int maxVectors);
   
 
 private:
+  Packet();
+
+  // takes a buffer of length bytes from pool, or the heap
+  // if there is no pool or the pool's slabs are too small
+  void allocate(size_t length);
+  void build(uint8_t field, uint32_t seqNumber, uint32_t ackNumber, const void *firstBuffer,
+      size_t firstBufferLength, const void *secondBuffer, size_t secondBufferLength);
+
   char *buffer;
   size_t length;
   ptime sendingTime;
+  PacketPool *pool; // NULL when buffer came from the heap
+  size_t capacity;  // length buffer was allocated with, picks its slab size
+
+  // caller owned payload of a scattered packet
+  struct iovec *segments;
+  int segmentCount;
+  size_t segmentLength;
+  boost::function<void()> onRelease;
 };
 
 #endif /* PACKET_H_ */
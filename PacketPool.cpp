@@ -0,0 +1,76 @@
+/*
+ * PacketPool.cpp
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#include "PacketPool.h"
+
+PacketPool::SizeClass::SizeClass(size_t slabSize, int slabsPerChunk) : freeSlabs(slabsPerChunk) {
+  this->slabSize = slabSize;
+  chunks = 0;
+}
+
+PacketPool::PacketPool(size_t slabSize, int slabsPerChunk) :
+    slabsPerChunk(clampSlabs(slabsPerChunk)),
+    small(SMALLSLABSIZE < slabSize ? SMALLSLABSIZE : slabSize, this->slabsPerChunk),
+    large(slabSize, this->slabsPerChunk) {
+}
+
+PacketPool::~PacketPool() {
+  for (size_t i = 0; i < chunks.size(); i++) {
+    delete[] chunks[i];
+  }
+}
+
+char* PacketPool::allocate(size_t length) {
+  if (length > large.slabSize) {
+    return NULL;
+  }
+  SizeClass &size = sizeClass(length);
+  char *slab;
+  while (!size.freeSlabs.pop(slab)) {
+    grow(size);
+  }
+  return slab;
+}
+
+void PacketPool::release(char *slab, size_t length) {
+  // the free list has a node reserved for every slab ever
+  // carved, so pushing back never allocates
+  sizeClass(length).freeSlabs.bounded_push(slab);
+}
+
+size_t PacketPool::getSlabSize() {
+  return large.slabSize;
+}
+
+int PacketPool::clampSlabs(int slabsPerChunk) {
+  if (slabsPerChunk < 1) {
+    return 1;
+  }
+  return (slabsPerChunk < MAXSLABSPERCHUNK) ? slabsPerChunk : MAXSLABSPERCHUNK;
+}
+
+PacketPool::SizeClass& PacketPool::sizeClass(size_t length) {
+  return (length <= small.slabSize) ? small : large;
+}
+
+void PacketPool::grow(SizeClass &size) {
+  boost::mutex::scoped_lock l(growMutex);
+  // another thread may have refilled the pool while we waited
+  if (!size.freeSlabs.empty()) {
+    return;
+  }
+  // chunks are large enough to be mapped lazily, so slabs
+  // cost no memory until they are first touched
+  char *chunk = new char[size.slabSize * slabsPerChunk];
+  chunks.push_back(chunk);
+  // the first chunk uses the nodes reserved by the constructor
+  if (size.chunks++ > 0) {
+    size.freeSlabs.reserve(slabsPerChunk);
+  }
+  for (int i = 0; i < slabsPerChunk; i++) {
+    size.freeSlabs.bounded_push(chunk + i * size.slabSize);
+  }
+}
@@ -0,0 +1,84 @@
+/*
+ * PacketPool.h
+ *
+ *  Created on: Oct 16, 2026
+ *
+ *  The PacketPool class hands out fixed-size slabs that
+ *  Packet uses as its buffer.  Slabs are carved out of large
+ *  chunks and recycled through a lock-free free list, so
+ *  steady-state sending and receiving never calls malloc.
+ *  Each UDPPlus object owns one pool.
+ *
+ *  Slabs come in two sizes: the largest datagram, and a small
+ *  one that fits acks, probes and short messages, so the many
+ *  control packets do not each tie up a full size slab.
+ */
+
+//          Copyright Joe Coder 2004 - 2006.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+
+#ifndef PACKETPOOL_H_
+#define PACKETPOOL_H_
+
+#include "utility.h"
+
+#include <boost/lockfree/stack.hpp>
+
+class PacketPool {
+public:
+  // an ack with every SACK block the header has room for
+  // still fits a small slab
+  const static size_t SMALLSLABSIZE = 256;
+  // bounds a chunk, and the free list nodes reserved up front
+  const static int MAXSLABSPERCHUNK = 4096;
+
+  // slabSize is the largest buffer the pool can hand out
+  // slabsPerChunk slabs of a size are allocated each time
+  // that size runs dry, at least 1 and at most MAXSLABSPERCHUNK
+  PacketPool(size_t slabSize, int slabsPerChunk);
+
+  // frees every chunk
+  // all slabs must have been released before this point
+  ~PacketPool();
+
+  // returns a slab of at least length bytes, a small one
+  // if length fits
+  // returns NULL if length is larger than a slab
+  char* allocate(size_t length);
+
+  // returns a slab from allocate to the free list
+  // length is the one it was allocated with
+  void release(char *slab, size_t length);
+
+  size_t getSlabSize();
+
+private:
+  // slabs of one size and the free list they are recycled through
+  struct SizeClass {
+    SizeClass(size_t slabSize, int slabsPerChunk);
+
+    size_t slabSize;
+    int chunks;           // carved so far, guarded by growMutex
+    boost::lockfree::stack<char*> freeSlabs;
+  };
+
+  // slabsPerChunk within 1 and MAXSLABSPERCHUNK
+  static int clampSlabs(int slabsPerChunk);
+  // the size a slab of length bytes is drawn from
+  SizeClass& sizeClass(size_t length);
+  // allocates another chunk and puts its slabs on the free list
+  void grow(SizeClass &size);
+
+  int slabsPerChunk;
+  SizeClass small;
+  SizeClass large;
+
+  // guards chunks, only taken when the pool grows
+  boost::mutex growMutex;
+  vector<char*> chunks;
+};
+
+#endif /* PACKETPOOL_H_ */
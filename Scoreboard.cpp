@@ -0,0 +1,133 @@
+/*
+ * Scoreboard.cpp
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#include "Scoreboard.h"
+
+Scoreboard::Scoreboard(SerialNumber serial) : serial(serial), ranges(Before(serial)) {
+  marked = 0;
+}
+
+void Scoreboard::reset(SerialNumber serial) {
+  this->serial = serial;
+  ranges = RangeMap(Before(serial));
+  marked = 0;
+}
+
+void Scoreboard::clear() {
+  ranges.clear();
+  marked = 0;
+}
+
+int Scoreboard::add(uint32_t start, uint32_t end) {
+  if (!serial.lessThan(start, end)) {
+    return 0;
+  }
+  int before = 0;
+  RangeMap::iterator it = ranges.upper_bound(start);
+  if (it != ranges.begin()) {
+    RangeMap::iterator previous = it;
+    --previous;
+    if (serial.lessEqual(start, previous->second)) {
+      start = previous->first;
+      if (serial.lessThan(end, previous->second)) {
+        end = previous->second;
+      }
+      before += serial.diff(previous->second, previous->first);
+      ranges.erase(previous);
+    }
+  }
+  while (it != ranges.end() && serial.lessEqual(it->first, end)) {
+    if (serial.lessThan(end, it->second)) {
+      end = it->second;
+    }
+    before += serial.diff(it->second, it->first);
+    ranges.erase(it++);
+  }
+  ranges.insert(it, make_pair(start, end));
+  int added = serial.diff(end, start) - before;
+  marked += added;
+  return added;
+}
+
+void Scoreboard::advance(uint32_t seq) {
+  while (!ranges.empty() && serial.lessThan(ranges.begin()->first, seq)) {
+    RangeMap::iterator first = ranges.begin();
+    uint32_t end = first->second;
+    marked -= serial.diff(end, first->first);
+    ranges.erase(first);
+    if (serial.lessThan(seq, end)) {
+      // the ack landed inside the range, keep the rest
+      ranges.insert(make_pair(seq, end));
+      marked += serial.diff(end, seq);
+      break;
+    }
+  }
+}
+
+bool Scoreboard::contains(uint32_t seq) {
+  RangeMap::iterator it = ranges.upper_bound(seq);
+  if (it == ranges.begin()) {
+    return false;
+  }
+  --it;
+  return serial.lessThan(seq, it->second);
+}
+
+uint32_t Scoreboard::nextGap(uint32_t seq) {
+  RangeMap::iterator it = ranges.upper_bound(seq);
+  if (it == ranges.begin()) {
+    return seq;
+  }
+  --it;
+  // ranges are merged, so the end of one is never marked
+  return serial.lessThan(seq, it->second) ? it->second : seq;
+}
+
+bool Scoreboard::lossBoundary(int threshold, uint32_t &boundary) {
+  // walk down from the highest range until threshold
+  // marked sequence numbers have been passed
+  int above = 0;
+  for (RangeMap::reverse_iterator it = ranges.rbegin(); it != ranges.rend(); ++it) {
+    int length = serial.diff(it->second, it->first);
+    if (above + length >= threshold) {
+      boundary = serial.add(it->second, -(threshold - above));
+      return true;
+    }
+    above += length;
+  }
+  return false;
+}
+
+int Scoreboard::blocks(uint32_t latest, uint32_t *starts, uint32_t *ends, int max) {
+  int count = 0;
+  RangeMap::iterator recent = ranges.end();
+  RangeMap::iterator it = ranges.upper_bound(latest);
+  if (it != ranges.begin()) {
+    --it;
+    if (serial.lessThan(latest, it->second) && count < max) {
+      recent = it;
+      starts[count] = it->first;
+      ends[count] = it->second;
+      count++;
+    }
+  }
+  for (it = ranges.begin(); it != ranges.end() && count < max; ++it) {
+    if (it != recent) {
+      starts[count] = it->first;
+      ends[count] = it->second;
+      count++;
+    }
+  }
+  return count;
+}
+
+bool Scoreboard::empty() {
+  return ranges.empty();
+}
+
+int Scoreboard::count() {
+  return marked;
+}
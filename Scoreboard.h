@@ -0,0 +1,78 @@
+/*
+ * Scoreboard.h
+ *
+ *  Created on: Oct 16, 2026
+ *
+ *  The Scoreboard class keeps a set of sequence numbers as
+ *  sorted, merged [start, end) ranges.  The sender uses one to
+ *  record which packets in flight the peer has SACKed and to
+ *  decide which holes are lost, the receiver uses one to
+ *  record the out of order packets it will report in its
+ *  SACK blocks.
+ *
+ *  Marking a range, looking up a packet and finding the next
+ *  hole are O(log n) in the number of ranges, not in the
+ *  number of packets in flight.
+ */
+
+//          Copyright Joe Coder 2004 - 2006.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+
+#ifndef SCOREBOARD_H_
+#define SCOREBOARD_H_
+
+#include "utility.h"
+#include "SerialNumber.h"
+
+#include <map>
+
+class Scoreboard {
+public:
+  Scoreboard(SerialNumber serial = SerialNumber());
+
+  // forgets every range and switches to the given sequence space
+  void reset(SerialNumber serial);
+  // forgets every range
+  void clear();
+
+  // marks [start, end), merging it with the ranges it touches
+  // returns how many sequence numbers were not marked before
+  int add(uint32_t start, uint32_t end);
+  // forgets everything before seq, once it is cumulatively acked
+  void advance(uint32_t seq);
+
+  bool contains(uint32_t seq);
+  // seq if it is not marked, otherwise the end of its range
+  uint32_t nextGap(uint32_t seq);
+  // finds the point below which every unmarked sequence number
+  // has at least threshold marked ones after it
+  // returns false if fewer than threshold are marked
+  bool lossBoundary(int threshold, uint32_t &boundary);
+
+  // copies up to max ranges, the one holding latest first
+  // and then the rest from lowest to highest
+  // returns the number of ranges copied
+  int blocks(uint32_t latest, uint32_t *starts, uint32_t *ends, int max);
+
+  bool empty();
+  // sequence numbers marked
+  int count();
+
+private:
+  // orders sequence numbers within half the space of each other
+  struct Before {
+    Before(SerialNumber serial) : serial(serial) {}
+    bool operator()(uint32_t a, uint32_t b) const { return serial.lessThan(a, b); }
+    SerialNumber serial;
+  };
+  typedef map<uint32_t, uint32_t, Before> RangeMap;
+
+  SerialNumber serial;
+  RangeMap ranges; // start to end, never overlapping or adjacent
+  int marked;
+};
+
+#endif /* SCOREBOARD_H_ */
@@ -0,0 +1,43 @@
+/*
+ * SerialNumber.cpp
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#include "SerialNumber.h"
+
+SerialNumber::SerialNumber(int bits) {
+  this->bits = (bits == 32) ? 32 : 16;
+  mask = (this->bits == 32) ? 0xFFFFFFFFu : 0xFFFFu;
+}
+
+uint32_t SerialNumber::add(uint32_t a, int64_t n) const {
+  return (uint32_t) (a + n) & mask;
+}
+
+int32_t SerialNumber::diff(uint32_t a, uint32_t b) const {
+  // move the space's sign bit to bit 31 and shift back
+  // so the difference comes out sign extended
+  int shift = 32 - bits;
+  return ((int32_t) ((a - b) << shift)) >> shift;
+}
+
+bool SerialNumber::lessThan(uint32_t a, uint32_t b) const {
+  return diff(a, b) < 0;
+}
+
+bool SerialNumber::lessEqual(uint32_t a, uint32_t b) const {
+  return diff(a, b) <= 0;
+}
+
+uint32_t SerialNumber::wrap(uint32_t a) const {
+  return a & mask;
+}
+
+int SerialNumber::getBits() const {
+  return bits;
+}
+
+uint32_t SerialNumber::maxWindow() const {
+  return (mask >> 1);
+}
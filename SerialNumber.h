@@ -0,0 +1,48 @@
+/*
+ * SerialNumber.h
+ *
+ *  Created on: Oct 16, 2026
+ *
+ *  The SerialNumber class does RFC 1982 serial number
+ *  arithmetic for sequence and ack numbers.  A connection
+ *  uses a 16 bit space with the classic header and a 32 bit
+ *  space once the extended header is negotiated, and every
+ *  wrap-safe addition and comparison goes through here.
+ */
+
+//          Copyright Joe Coder 2004 - 2006.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+
+#ifndef SERIALNUMBER_H_
+#define SERIALNUMBER_H_
+
+#include "utility.h"
+
+class SerialNumber {
+public:
+  // bits is 16 or 32
+  SerialNumber(int bits = 16);
+
+  // a + n, wrapped into the space
+  uint32_t add(uint32_t a, int64_t n) const;
+  // signed distance from b to a, positive when a is after b
+  // only meaningful while the two are less than half the space apart
+  int32_t diff(uint32_t a, uint32_t b) const;
+  bool lessThan(uint32_t a, uint32_t b) const;
+  bool lessEqual(uint32_t a, uint32_t b) const;
+  // wraps any number into the space
+  uint32_t wrap(uint32_t a) const;
+
+  int getBits() const;
+  // largest window the space can tell apart, half the space
+  uint32_t maxWindow() const;
+
+private:
+  int bits;
+  uint32_t mask;
+};
+
+#endif /* SERIALNUMBER_H_ */
@@ -0,0 +1,149 @@
+/*
+ * Task.h
+ *
+ *  Created on: Oct 16, 2026
+ *
+ *  The Task class is the return type of UDP+ coroutines.  A task
+ *  does nothing until it is awaited, or handed to an Executor
+ *  with spawn, and the coroutine awaiting it resumes as soon as
+ *  it finishes, without going back through the executor.
+ *
+ *  Coroutines need C++20.  UDPPLUS_COROUTINES is defined when the
+ *  compiler supports them, and the async calls on UDPPlus and
+ *  UDPPlusConnection only exist then.
+ */
+
+//          Copyright Joe Coder 2004 - 2006.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+
+#ifndef TASK_H_
+#define TASK_H_
+
+#if defined(__cpp_impl_coroutine) && __cplusplus >= 202002L
+#define UDPPLUS_COROUTINES
+
+#include <coroutine>
+#include <exception>
+#include <utility>
+
+class Executor;
+
+// state every task's promise keeps, whatever it returns
+struct TaskPromiseBase {
+  TaskPromiseBase() : sessions(NULL) {}
+
+  // resumes whoever awaited the task, or if the task was spawned
+  // tells the executor one session is over, it frees the frame
+  struct FinalAwaiter {
+    bool await_ready() noexcept { return false; }
+    template<class Promise>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> h) noexcept {
+      TaskPromiseBase &promise = h.promise();
+      if (promise.continuation) {
+        return promise.continuation;
+      }
+      if (promise.sessions != NULL) {
+        --*promise.sessions;
+      }
+      return std::noop_coroutine();
+    }
+    void await_resume() noexcept {}
+  };
+
+  std::suspend_always initial_suspend() noexcept { return std::suspend_always(); }
+  FinalAwaiter final_suspend() noexcept { return FinalAwaiter(); }
+  void unhandled_exception() { failure = std::current_exception(); }
+
+  std::coroutine_handle<> continuation;
+  std::exception_ptr failure;
+  // the executor's session count, NULL unless spawned
+  int *sessions;
+};
+
+template<class T> class Task;
+
+template<class T>
+struct TaskPromise : TaskPromiseBase {
+  Task<T> get_return_object();
+  void return_value(T v) { value = std::move(v); }
+  T result() {
+    if (failure) {
+      std::rethrow_exception(failure);
+    }
+    return std::move(value);
+  }
+  T value;
+};
+
+template<>
+struct TaskPromise<void> : TaskPromiseBase {
+  Task<void> get_return_object();
+  void return_void() {}
+  void result() {
+    if (failure) {
+      std::rethrow_exception(failure);
+    }
+  }
+};
+
+template<class T = void>
+class Task {
+public:
+  typedef TaskPromise<T> promise_type;
+  typedef std::coroutine_handle<promise_type> Handle;
+
+  explicit Task(Handle h) : handle(h) {}
+  Task(Task &&other) noexcept : handle(other.handle) { other.handle = Handle(); }
+  Task& operator=(Task &&other) noexcept {
+    if (this != &other) {
+      if (handle) {
+        handle.destroy();
+      }
+      handle = other.handle;
+      other.handle = Handle();
+    }
+    return *this;
+  }
+  Task(const Task&) = delete;
+  Task& operator=(const Task&) = delete;
+  ~Task() {
+    if (handle) {
+      handle.destroy();
+    }
+  }
+
+  // starts the task and suspends the caller until it finishes
+  struct Awaiter {
+    bool await_ready() noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept {
+      handle.promise().continuation = caller;
+      return handle;
+    }
+    T await_resume() { return handle.promise().result(); }
+    Handle handle;
+  };
+  Awaiter operator co_await() && noexcept { return Awaiter{handle}; }
+  Awaiter operator co_await() & noexcept { return Awaiter{handle}; }
+
+private:
+  Handle handle;
+
+  // spawn takes the frame over, it is freed once the task finishes
+  friend class Executor;
+};
+
+template<class T>
+inline Task<T> TaskPromise<T>::get_return_object() {
+  return Task<T>(std::coroutine_handle<TaskPromise<T> >::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object() {
+  return Task<void>(std::coroutine_handle<TaskPromise<void> >::from_promise(*this));
+}
+
+#endif
+
+#endif /* TASK_H_ */
@@ -0,0 +1,228 @@
+/*
+ * TimerWheel.cpp
+ *
+ *  Created on: Oct 16, 2026
+ */
+
+#include "TimerWheel.h"
+
+TimerWheel::Entry::Entry() {
+  prev = next = this;
+  expires = 0;
+  state = IDLE;
+}
+
+TimerWheel::TimerWheel(time_duration tick) {
+  start = microsec_clock::universal_time();
+  tickLength = tick;
+  if (tickLength.total_microseconds() < 1) {
+    tickLength = microseconds(1);
+  }
+  currentTick = 0;
+  scheduled = 0;
+  done = false;
+  running = NULL;
+  wakeTick = numeric_limits<uint64_t>::max();
+  slots = new Entry[ROOTSIZE + (LEVELS - 1) * LEVELSIZE];
+  wheelThread = new boost::thread(boost::bind(&TimerWheel::run, this));
+}
+
+TimerWheel::~TimerWheel() {
+  {
+    boost::mutex::scoped_lock l(wheelMutex);
+    done = true;
+    wheelCondition.notify_all();
+  }
+  wheelThread->join();
+  delete wheelThread;
+  delete[] slots;
+}
+
+void TimerWheel::schedule(Entry *entry, ptime when) {
+  boost::mutex::scoped_lock l(wheelMutex);
+  if (entry->state == Entry::SCHEDULED) {
+    scheduled--;
+  }
+  unlink(entry);
+  entry->expires = ticksAt(when);
+  if (entry->expires <= currentTick) {
+    link(&expired, entry);
+    entry->state = Entry::FIRING;
+    wheelCondition.notify_one();
+    return;
+  }
+  place(entry);
+  entry->state = Entry::SCHEDULED;
+  scheduled++;
+  // the wheel thread only needs waking if it sleeps past this entry
+  if (entry->expires < wakeTick) {
+    wheelCondition.notify_one();
+  }
+}
+
+void TimerWheel::wake(Entry *entry) {
+  boost::mutex::scoped_lock l(wheelMutex);
+  if (entry->state == Entry::FIRING) {
+    return;
+  }
+  if (entry->state == Entry::SCHEDULED) {
+    scheduled--;
+  }
+  unlink(entry);
+  link(&expired, entry);
+  entry->state = Entry::FIRING;
+  wheelCondition.notify_one();
+}
+
+void TimerWheel::cancel(Entry *entry) {
+  boost::mutex::scoped_lock l(wheelMutex);
+  // a running callback may reschedule itself, so wait first
+  while (running == entry) {
+    runningCondition.wait(l);
+  }
+  if (entry->state == Entry::SCHEDULED) {
+    scheduled--;
+  }
+  unlink(entry);
+  entry->state = Entry::IDLE;
+}
+
+size_t TimerWheel::size() {
+  boost::mutex::scoped_lock l(wheelMutex);
+  return scheduled;
+}
+
+void TimerWheel::run() {
+  boost::mutex::scoped_lock l(wheelMutex);
+  while (!done) {
+    time_duration elapsed = microsec_clock::universal_time() - start;
+    uint64_t nowTick = elapsed.total_microseconds() / tickLength.total_microseconds();
+    while (currentTick < nowTick) {
+      advance();
+    }
+
+    while (!listEmpty(&expired)) {
+      Entry *entry = expired.next;
+      unlink(entry);
+      entry->state = Entry::IDLE;
+      running = entry;
+      l.unlock();
+      entry->callback();
+      l.lock();
+      running = NULL;
+      runningCondition.notify_all();
+    }
+
+    if (done) {
+      break;
+    }
+    if (scheduled == 0) {
+      wakeTick = numeric_limits<uint64_t>::max();
+      wheelCondition.wait(l);
+    }
+    else {
+      wakeTick = nextEvent();
+      if (wakeTick > currentTick) {
+        wheelCondition.timed_wait(l, timeAt(wakeTick));
+      }
+    }
+    wakeTick = currentTick;
+  }
+}
+
+void TimerWheel::advance() {
+  currentTick++;
+  int index = currentTick & (ROOTSIZE - 1);
+
+  // on every full turn of a level, the next slot of the level
+  // above is spread back over the finer levels
+  for (int level = 1; level < LEVELS && index == 0; level++) {
+    int shift = ROOTBITS + (level - 1) * LEVELBITS;
+    index = (currentTick >> shift) & (LEVELSIZE - 1);
+    Entry *head = slot(level, index);
+    while (!listEmpty(head)) {
+      Entry *entry = head->next;
+      unlink(entry);
+      place(entry);
+    }
+  }
+
+  Entry *head = slot(0, currentTick & (ROOTSIZE - 1));
+  while (!listEmpty(head)) {
+    Entry *entry = head->next;
+    unlink(entry);
+    link(&expired, entry);
+    entry->state = Entry::FIRING;
+    scheduled--;
+  }
+}
+
+void TimerWheel::place(Entry *entry) {
+  uint64_t delta = entry->expires - currentTick;
+  if (delta < (uint64_t) ROOTSIZE) {
+    link(slot(0, entry->expires & (ROOTSIZE - 1)), entry);
+    return;
+  }
+  int level = 1;
+  int shift = ROOTBITS;
+  for (; level < LEVELS - 1; level++, shift += LEVELBITS) {
+    if (delta < ((uint64_t) 1 << (shift + LEVELBITS))) {
+      break;
+    }
+  }
+  // anything past the last level waits in its farthest slot
+  uint64_t limit = ((uint64_t) 1 << (shift + LEVELBITS)) - 1;
+  if (delta > limit) {
+    entry->expires = currentTick + limit;
+  }
+  link(slot(level, (entry->expires >> shift) & (LEVELSIZE - 1)), entry);
+}
+
+TimerWheel::Entry* TimerWheel::slot(int level, int index) {
+  if (level == 0) {
+    return &slots[index];
+  }
+  return &slots[ROOTSIZE + (level - 1) * LEVELSIZE + index];
+}
+
+uint64_t TimerWheel::nextEvent() {
+  // the root level is scanned up to the next cascade, which
+  // is the earliest any coarser entry could become due
+  uint64_t boundary = (currentTick | (ROOTSIZE - 1)) + 1;
+  for (uint64_t tick = currentTick + 1; tick < boundary; tick++) {
+    if (!listEmpty(slot(0, tick & (ROOTSIZE - 1)))) {
+      return tick;
+    }
+  }
+  return boundary;
+}
+
+uint64_t TimerWheel::ticksAt(ptime when) {
+  int64_t elapsed = (when - start).total_microseconds();
+  if (elapsed <= 0) {
+    return 0;
+  }
+  int64_t tick = tickLength.total_microseconds();
+  return (elapsed + tick - 1) / tick;
+}
+
+ptime TimerWheel::timeAt(uint64_t tick) {
+  return start + microseconds(tick * tickLength.total_microseconds());
+}
+
+void TimerWheel::link(Entry *head, Entry *entry) {
+  entry->prev = head->prev;
+  entry->next = head;
+  head->prev->next = entry;
+  head->prev = entry;
+}
+
+void TimerWheel::unlink(Entry *entry) {
+  entry->prev->next = entry->next;
+  entry->next->prev = entry->prev;
+  entry->prev = entry->next = entry;
+}
+
+bool TimerWheel::listEmpty(Entry *head) {
+  return head->next == head;
+}
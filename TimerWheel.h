@@ -0,0 +1,130 @@
+/*
+ * TimerWheel.h
+ *
+ *  Created on: Oct 16, 2026
+ *
+ *  The TimerWheel class is a hierarchical timing wheel driven
+ *  by a single thread.  It replaces the timer thread every
+ *  UDPPlusConnection used to start: connections schedule an
+ *  Entry for the next time they need to retransmit, send a
+ *  delayed ACK or check for idleness, and the wheel thread
+ *  runs the entry's callback once that time has passed.
+ *
+ *  Scheduling and cancelling are O(1).  Entries more than one
+ *  rotation of the finest level away live on coarser levels
+ *  and are cascaded down as the wheel turns.
+ */
+
+//          Copyright Joe Coder 2004 - 2006.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+
+#ifndef TIMERWHEEL_H_
+#define TIMERWHEEL_H_
+
+#include "utility.h"
+
+#include <boost/function.hpp>
+
+using namespace boost::posix_time;
+
+class TimerWheel {
+public:
+  // a timer that can be scheduled on the wheel
+  // an entry is scheduled at most once, scheduling it again moves it
+  class Entry {
+  public:
+    Entry();
+
+    // runs on the wheel thread without any wheel lock held
+    boost::function<void()> callback;
+
+  private:
+    enum EntryState { IDLE, SCHEDULED, FIRING };
+
+    Entry *prev;
+    Entry *next;
+    uint64_t expires; // in ticks
+    EntryState state;
+
+    friend class TimerWheel;
+  };
+
+  // starts the wheel thread
+  // tick is the resolution timers are rounded up to
+  TimerWheel(time_duration tick = milliseconds(1));
+
+  // stops the wheel thread
+  // entries still scheduled are dropped without running
+  virtual ~TimerWheel();
+
+  // runs entry's callback once when has passed
+  void schedule(Entry *entry, ptime when);
+
+  // runs entry's callback as soon as possible
+  void wake(Entry *entry);
+
+  // unschedules entry
+  // if its callback is running, waits for it to return
+  void cancel(Entry *entry);
+
+  // number of entries waiting on the wheel
+  size_t size();
+
+private:
+  const static int LEVELS = 4;
+  const static int ROOTBITS = 8;  // 256 slots of one tick
+  const static int LEVELBITS = 6; // 64 slots on every coarser level
+  const static int ROOTSIZE = 1 << ROOTBITS;
+  const static int LEVELSIZE = 1 << LEVELBITS;
+
+  // this method is threaded
+  // turns the wheel and runs expired callbacks
+  void run();
+
+  // moves the wheel forward one tick, cascading coarser levels
+  // and collecting entries that expire on the new tick
+  void advance();
+
+  // places a scheduled entry in the slot for its expiry
+  void place(Entry *entry);
+
+  // returns the list head of a slot
+  Entry* slot(int level, int index);
+
+  // first tick worth waking up for
+  uint64_t nextEvent();
+
+  uint64_t ticksAt(ptime when);
+  ptime timeAt(uint64_t tick);
+
+  static void link(Entry *head, Entry *entry);
+  static void unlink(Entry *entry);
+  static bool listEmpty(Entry *head);
+
+  ptime start;
+  time_duration tickLength;
+  uint64_t currentTick;
+  size_t scheduled;
+
+  // sentinel heads: ROOTSIZE root slots, then
+  // LEVELSIZE slots for each coarser level
+  Entry *slots;
+  // entries whose time has come, waiting for their callback
+  Entry expired;
+
+  // tick the wheel thread sleeps until, schedule only
+  // wakes it for entries due before then
+  uint64_t wakeTick;
+
+  bool done;
+  Entry *running;
+  boost::mutex wheelMutex;
+  boost::condition_variable wheelCondition;
+  boost::condition_variable runningCondition;
+  boost::thread *wheelThread;
+};
+
+#endif /* TIMERWHEEL_H_ */
@@ -10,28 +10,95 @@
 #include "utility.h"
 #include "UDPPlusConnection.h"
 #include "Packet.h"
+#include "Executor.h"
+#include "Logger.h"
 
 using namespace std;
 
-UDPPlus::UDPPlus(int max_conn, int buf) {
+UDPPlus::Shard::Shard(int capacity) : demux(capacity) {
+  sockfd = -1;
+  listener = NULL;
+  outgoing = NULL;
+  datagramsReceived = bytesReceived = receiveCalls = 0;
+  invalidDatagrams = strayDatagrams = refusedConnections = 0;
+  datagramsSent = bytesSent = batchesFlushed = sendErrors = 0;
+}
+
+// a counter with one writer, or writers that share a lock, needs
+// no locked instruction
+static void bump(boost::atomic<uint64_t> &counter, uint64_t amount = 1) {
+  counter.store(counter.load(boost::memory_order_relaxed) + amount, boost::memory_order_relaxed);
+}
+
+UDPPlus::Shard::~Shard() {
+  delete outgoing;
+}
+
+UDPPlus::UDPPlus(int max_conn, int buf, int shardCount) : packetPool(RECVBUFFERSIZE, buf) {
 	max_connections = max_conn;
 	bufferSize = buf;
 	connectionList = new UDPPlusConnection*[max_conn];
 	bounded = false;
 	waiting = false;
+  waitingConnection = NULL;
+  acceptQueueing = false;
   listenerDone = false;
+  batchSize = 1;
+  flushDeadline = microseconds(500);
+  flushThread = NULL;
+  flushPending = false;
+  extendedHeaders = true;
+  transport = NULL;
+  nextShard = 0;
+
+#ifndef SO_REUSEPORT
+  // without SO_REUSEPORT the kernel cannot spread peers over sockets
+  shardCount = 1;
+#endif
+  if (shardCount < 1) shardCount = 1;
+  if (shardCount > max_conn) shardCount = max_conn;
+  numShards = shardCount;
 	
 	// make all slots initially null
 	for(int i=0; i < max_conn; i++)
 		connectionList[i] = NULL;
+  // lowest slots are handed out first
+  for (int i = max_conn - 1; i >= 0; i--) {
+    freeSlots.push_back(i);
+  }
+
+  for (int s = 0; s < numShards; s++) {
+    // any shard may end up holding every connection
+    Shard *shard = new Shard(max_conn);
 	
-  // create UDP socket to work with IPv4 and IPv6
-	sockfd = socket(AF_INET, SOCK_DGRAM, 0);
-	if(sockfd < 0) {
-		// throw error
-		printf("error creating socket");
-		exit(0);
-	}
+    // create UDP socket to work with IPv4 and IPv6
+    shard->sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    if(shard->sockfd < 0) {
+      // throw error
+      printf("error creating socket");
+      exit(0);
+    }
+#ifdef SO_REUSEPORT
+    if (numShards > 1) {
+      int enable = 1;
+      if (setsockopt(shard->sockfd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) < 0) {
+        printf("error setting SO_REUSEPORT");
+        exit(0);
+      }
+    }
+#endif
+#ifdef IP_MTU_DISCOVER
+    // don't fragment, a path MTU probe too big for the path must
+    // be lost rather than split.  probe mode ignores the kernel's
+    // own estimate, connections keep their own
+    int discover = IP_PMTUDISC_PROBE;
+    if (setsockopt(shard->sockfd, IPPROTO_IP, IP_MTU_DISCOVER, &discover, sizeof(discover)) < 0) {
+      printf("error setting IP_MTU_DISCOVER");
+      exit(0);
+    }
+#endif
+    shards.push_back(shard);
+  }
 }
 
 UDPPlus::~UDPPlus() {
@@ -39,16 +106,28 @@ UDPPlus::~UDPPlus() {
   close_all();
 
   waitingCondition.notify_all();
-  close(sockfd);
-  listener->join();  
+  // stop listener threads
+  for (int s = 0; s < numShards; s++) {
+    if (shards[s]->listener != NULL) {
+      shards[s]->listener->join();
+      delete shards[s]->listener;
+    }
+  }
+  if (flushThread != NULL) {
+    flushThread->join();
+    delete flushThread;
+  }
   for (int i = 0; i < max_connections; i++) {
     if (connectionList[i] != NULL) {
       delete connectionList[i];
       connectionList[i] = NULL;
     }
   }
-  // stop listener thread
-	delete connectionList;
+  for (int s = 0; s < numShards; s++) {
+    delete shards[s];
+  }
+  delete transport;
+	delete[] connectionList;
 }
 
 void UDPPlus::bind_p(const struct sockaddr *info, const socklen_t &infoLength) {
@@ -60,28 +139,233 @@ void UDPPlus::bind_p(const struct sockaddr *info, const socklen_t &infoLength) {
 		exit(1);
 	}
 
-	if (bind(sockfd, info, infoLength) < 0) {
-    exit(2);
+  if (transport != NULL) {
+    if (transport->bind(info, infoLength) < 0) {
+      exit(2);
+    }
+  }
+  for (int s = 0; s < numShards && transport == NULL; s++) {
+    if (bind(shards[s]->sockfd, info, infoLength) < 0) {
+      exit(2);
+    }
   }
   mode = LISTENING;
-  listener = new boost::thread(boost::bind(&UDPPlus::listen, this));
+  startListeners();
+}
+
+void UDPPlus::startListeners() {
+  for (int s = 0; s < numShards; s++) {
+    shards[s]->listener = new boost::thread(boost::bind(&UDPPlus::listen, this, s));
+  }
+  if (batchSize > 1) {
+    flushThread = new boost::thread(boost::bind(&UDPPlus::flusher, this));
+  }
+}
+
+void UDPPlus::closeSockets() {
+  listenerDone = true;
+  {
+    boost::mutex::scoped_lock f(flushMutex);
+    flushCondition.notify_all();
+  }
+  for (int s = 0; s < numShards; s++) {
+    boost::mutex::scoped_lock l(shards[s]->sendMutex);
+    if (shards[s]->sockfd >= 0) {
+      if (shards[s]->outgoing != NULL) {
+        flushShard(*shards[s]);
+      }
+      // close alone does not wake a thread blocked in recvfrom
+      shutdown(shards[s]->sockfd, SHUT_RDWR);
+    }
+  }
+  if (transport != NULL) {
+    boost::mutex::scoped_lock l(shards[0]->sendMutex);
+    if (shards[0]->outgoing != NULL) {
+      flushShard(*shards[0]);
+    }
+    transport->close();
+  }
+  // the listeners must be gone before their descriptors can be reused
+  for (int s = 0; s < numShards; s++) {
+    if (shards[s]->listener != NULL) {
+      shards[s]->listener->join();
+      delete shards[s]->listener;
+      shards[s]->listener = NULL;
+    }
+  }
+  for (int s = 0; s < numShards; s++) {
+    boost::mutex::scoped_lock l(shards[s]->sendMutex);
+    if (shards[s]->sockfd >= 0) {
+      close(shards[s]->sockfd);
+      shards[s]->sockfd = -1;
+    }
+  }
 }
 
-void UDPPlus::send_p(struct sockaddr *connection, socklen_t len, Packet* p) {
-  
-  //cout << "->";
-  //p->print();
-  int errorNumber = sendto(sockfd, p->getBuffer(), p->getLength(), 0, connection, len);
-  if ( errorNumber == -1 ) {
-    cout << errno;
-    cout << EISCONN;
-    exit(0);
+void UDPPlus::send_p(struct sockaddr *connection, socklen_t len, Packet* p, int index) {
+  Shard &shard = *shards[index];
+  // send_p runs on every thread, unlike the listener's counters
+  shard.datagramsSent.fetch_add(1, boost::memory_order_relaxed);
+  shard.bytesSent.fetch_add(p->getLength(), boost::memory_order_relaxed);
+  if (p->isScattered()) {
+    sendScattered(shard, connection, len, p);
+    return;
+  }
+  if (batchSize > 1) {
+    boost::mutex::scoped_lock l(shard.sendMutex);
+    if (shard.outgoing->add(connection, len, p->getBuffer(), p->getLength())) {
+      if (shard.outgoing->size() == 1) {
+        // first datagram in the batch starts the flush deadline
+        shard.firstQueued = microsec_clock::universal_time();
+        boost::mutex::scoped_lock f(flushMutex);
+        flushPending = true;
+        flushCondition.notify_one();
+      }
+      if (shard.outgoing->full()) {
+        flushShard(shard);
+      }
+      return;
+    }
+    // too large for a batch slot, keep ordering and send it alone
+    flushShard(shard);
+  }
+  struct iovec vector = { p->getBuffer(), p->getLength() };
+  sendDatagram(shard, connection, len, &vector, 1);
+}
+
+void UDPPlus::sendDatagram(Shard &shard, struct sockaddr *connection, socklen_t len,
+    struct iovec *vectors, int count) {
+  struct msghdr message;
+  memset(&message, 0, sizeof(message));
+  message.msg_name = connection;
+  message.msg_namelen = len;
+  message.msg_iov = vectors;
+  message.msg_iovlen = count;
+  int result;
+  int attempts = 0;
+  do {
+    if (transport != NULL) {
+      result = transport->send(connection, len, vectors, count);
+    }
+    else {
+      result = sendmsg(shard.sockfd, &message, 0);
+    }
+  } while (result < 0 && DatagramBatch::retryable(errno) && attempts++ < DatagramBatch::SENDRETRIES);
+  // longer than the local link, lost like any packet too big for the path
+  if (result < 0 && errno != EMSGSIZE) {
+    droppedSends(shard, 1);
+  }
+}
+
+void UDPPlus::droppedSends(Shard &shard, int count) {
+  // lost like any other packet, retransmission recovers the data
+  shard.sendErrors.fetch_add(count, boost::memory_order_relaxed);
+  UDPPLUS_WARN("send: %s, %d datagrams dropped", strerror(errno), count);
+}
+
+void UDPPlus::sendScattered(Shard &shard, struct sockaddr *connection, socklen_t len, Packet *p) {
+  struct iovec vectors[MAXSEGMENTS + 1];
+  int count = p->getSegments(vectors, MAXSEGMENTS + 1);
+
+  boost::mutex::scoped_lock l(shard.sendMutex);
+  // anything already batched has to leave first to keep ordering
+  if (shard.outgoing != NULL) {
+    flushShard(shard);
+  }
+  sendDatagram(shard, connection, len, vectors, count);
+}
+
+void UDPPlus::flushShard(Shard &shard) {
+  if (shard.outgoing->empty()) {
+    return;
+  }
+  bump(shard.batchesFlushed);
+  DatagramBatch &batch = *shard.outgoing;
+  if (transport != NULL) {
+    for (int i = 0; i < batch.size(); i++) {
+      struct iovec vector = { batch.getBuffer(i), batch.getLength(i) };
+      sendDatagram(shard, batch.getAddress(i), batch.getAddressLength(i), &vector, 1);
+    }
+    batch.clear();
+    return;
+  }
+  int queued = batch.size();
+  int sent = batch.flush(shard.sockfd);
+  if (sent < queued) {
+    droppedSends(shard, queued - sent);
+  }
+}
+
+void UDPPlus::flusher() {
+  while (!listenerDone) {
+    ptime currentTime(microsec_clock::universal_time());
+    ptime nextDeadline(pos_infin);
+    for (int s = 0; s < numShards; s++) {
+      boost::mutex::scoped_lock l(shards[s]->sendMutex);
+      if (shards[s]->outgoing->empty()) {
+        continue;
+      }
+      ptime deadline = shards[s]->firstQueued + flushDeadline;
+      if (deadline <= currentTime) {
+        flushShard(*shards[s]);
+      }
+      else if (deadline < nextDeadline) {
+        nextDeadline = deadline;
+      }
+    }
+    boost::mutex::scoped_lock f(flushMutex);
+    if (!flushPending && !listenerDone) {
+      if (nextDeadline.is_pos_infinity()) {
+        flushCondition.wait(f);
+      }
+      else {
+        flushCondition.timed_wait(f, nextDeadline);
+      }
+    }
+    flushPending = false;
+  }
+}
+
+void UDPPlus::setBatching(int batch, time_duration deadline) {
+  if (bounded) {
+    printf("batching must be set before binding");
+    exit(1);
+  }
+  batchSize = (batch < 1) ? 1 : batch;
+  flushDeadline = deadline;
+  for (int s = 0; s < numShards; s++) {
+    delete shards[s]->outgoing;
+    shards[s]->outgoing = new DatagramBatch(batchSize, RECVBUFFERSIZE);
   }
 }
 
+void UDPPlus::setTransport(DatagramTransport *transport) {
+  if (bounded || numShards != 1) {
+    printf("a transport must be set before binding, with one shard");
+    exit(1);
+  }
+  // the socket made by the constructor is never used
+  close(shards[0]->sockfd);
+  shards[0]->sockfd = -1;
+  delete this->transport;
+  this->transport = transport;
+}
+
+void UDPPlus::setExtendedHeaders(bool enabled) {
+  if (bounded) {
+    printf("extended headers must be set before binding");
+    exit(1);
+  }
+  extendedHeaders = enabled;
+}
 
 UDPPlusConnection * UDPPlus::accept_p() {
 	boost::mutex::scoped_lock l(waitingMutex);
+  if (!acceptQueue.empty()) {
+    UDPPlusConnection *queued = acceptQueue.front();
+    acceptQueue.pop_front();
+    return queued;
+  }
 	waiting = true;
 	if (waitingConnection == NULL)
 		waitingCondition.wait(l);
@@ -94,123 +378,276 @@ UDPPlusConnection * UDPPlus::accept_p() {
 	return tempConnection;
 }
 
-void UDPPlus::listen() {
-	char buffer[5000];
-	int location;
-  Mode tempMode = mode;
-	struct sockaddr connection;
-  //cerr << "listening thread created";
-	socklen_t connectionLength;
-	while(true) {
-		memset(&connection, 0, sizeof(connection));
-		connectionLength = sizeof(connection);
-    //cerr << "listening for packet\n";
-    int length;
-    if (tempMode == CONNECTED)
-    {
-      length = recv(sockfd, buffer, sizeof(buffer), 0);
+UDPPlusConnection* UDPPlus::try_accept() {
+  boost::mutex::scoped_lock l(waitingMutex);
+  if (acceptQueue.empty()) {
+    errno = EAGAIN;
+    acceptEvent.reset();
+    return NULL;
+  }
+  UDPPlusConnection *queued = acceptQueue.front();
+  acceptQueue.pop_front();
+  return queued;
+}
+
+int UDPPlus::getEventFd() {
+  boost::mutex::scoped_lock l(waitingMutex);
+  acceptQueueing = true;
+  return acceptEvent.descriptor();
+}
+
+SocketStats UDPPlus::getStats() {
+  SocketStats stats;
+  for (int s = 0; s < numShards; s++) {
+    Shard &shard = *shards[s];
+    stats.datagramsReceived += shard.datagramsReceived;
+    stats.bytesReceived += shard.bytesReceived;
+    stats.receiveCalls += shard.receiveCalls;
+    stats.invalidDatagrams += shard.invalidDatagrams;
+    stats.strayDatagrams += shard.strayDatagrams;
+    stats.refusedConnections += shard.refusedConnections;
+    stats.datagramsSent += shard.datagramsSent;
+    stats.bytesSent += shard.bytesSent;
+    stats.batchesFlushed += shard.batchesFlushed;
+    stats.sendErrors += shard.sendErrors;
+  }
+  {
+    boost::ptr_vector<boost::mutex::scoped_lock> locks;
+    lockShards(locks);
+    for (int i = 0; i < max_connections; i++) {
+      if (connectionList[i] != NULL) {
+        stats.connections++;
+      }
     }
-    else {
-      length = recvfrom(sockfd, buffer, sizeof(buffer), 0, &connection, &connectionLength);
+  }
+  boost::mutex::scoped_lock w(waitingMutex);
+  stats.acceptQueued = acceptQueue.size();
+  return stats;
+}
+
+// the peer's address and port, as a label value
+static string peerName(const struct sockaddr *address) {
+  char host[INET6_ADDRSTRLEN] = "";
+  int port = 0;
+  if (address->sa_family == AF_INET) {
+    const struct sockaddr_in *v4 = (const struct sockaddr_in *) address;
+    inet_ntop(AF_INET, &v4->sin_addr, host, sizeof(host));
+    port = ntohs(v4->sin_port);
+  }
+  else if (address->sa_family == AF_INET6) {
+    const struct sockaddr_in6 *v6 = (const struct sockaddr_in6 *) address;
+    inet_ntop(AF_INET6, &v6->sin6_addr, host, sizeof(host));
+    port = ntohs(v6->sin6_port);
+    ostringstream bracketed;
+    bracketed << "[" << host << "]:" << port;
+    return bracketed.str();
+  }
+  ostringstream name;
+  name << host << ":" << port;
+  return name.str();
+}
+
+void UDPPlus::writeStats(ostream &out, StatsFormat format) {
+  SocketStats socket = getStats();
+  // copied out first, a connection's lock is never held while writing
+  vector<string> peers;
+  vector<ConnectionStats> connections;
+  {
+    boost::ptr_vector<boost::mutex::scoped_lock> locks;
+    lockShards(locks);
+    for (int i = 0; i < max_connections; i++) {
+      if (connectionList[i] == NULL) {
+        continue;
+      }
+      socklen_t length;
+      peers.push_back(peerName(connectionList[i]->getSockAddr(length)));
+      connections.push_back(connectionList[i]->getStats());
     }
-    if (length == -1) {
+  }
+  if (format == PROMETHEUS) {
+    socket.writePrometheus(out);
+    for (size_t i = 0; i < connections.size(); i++) {
+      connections[i].writePrometheus(out, "peer=\"" + peers[i] + "\"");
+    }
+    return;
+  }
+  out << "{\"socket\":";
+  socket.writeJson(out);
+  out << ",\"connections\":[";
+  for (size_t i = 0; i < connections.size(); i++) {
+    out << (i > 0 ? "," : "") << "{\"peer\":\"" << peers[i] << "\",\"stats\":";
+    connections[i].writeJson(out);
+    out << "}";
+  }
+  out << "]}";
+}
+
+#ifdef UDPPLUS_COROUTINES
+Task<UDPPlusConnection*> UDPPlus::async_accept() {
+  int fd = getEventFd();
+  while (true) {
+    UDPPlusConnection *accepted = try_accept();
+    if (accepted != NULL || fd < 0) {
+      co_return accepted;
+    }
+    co_await Executor::readable(fd);
+  }
+}
+#endif
+
+void UDPPlus::listen(int index) {
+  Shard &shard = *shards[index];
+  // the kernel writes each datagram straight into a pool slab
+  // which the Packet built from it then takes over
+  DatagramBatch incoming(batchSize, RECVBUFFERSIZE, false);
+  for (int i = 0; i < incoming.getCapacity(); i++) {
+    incoming.setBuffer(i, packetPool.allocate(RECVBUFFERSIZE));
+  }
+  // closeSockets resets shard.sockfd while we may be blocked on it
+  int sockfd = shard.sockfd;
+	while(true) {
+    int count = (transport != NULL) ? transport->receive(incoming) : incoming.receive(sockfd);
+    if (count == -1 || listenerDone) {
       waitingCondition.notify_all();
-      //cout << errno;
-      //cerr << "listener thread: socket closed";
       break;
     }
-    //cerr << "waiting for mutex\n";
-    boost::mutex::scoped_lock l(waitingMutex);
-		location = isHostConnected(&connection, connectionLength);
-		if (location >= 0) {
-      Packet *temp = new Packet(buffer, length);
-      //cout << "<-";
-      temp->print();
-			connectionList[location]->handlePacket(temp);
-		}
-		else {
-			cout << "host not connected\n" << endl;
-			if (waiting == true) {
-				Packet *tempPacket = new Packet(buffer, length);
-        //cout << "<-";
-        tempPacket->print();
-				if (tempPacket->getField(Packet::SYN)) {
-          int location = findSlot();
+    bump(shard.receiveCalls);
+    bump(shard.datagramsReceived, count);
+    {
+      boost::mutex::scoped_lock l(shard.mutex);
+      for (int i = 0; i < count; i++) {
+        bump(shard.bytesReceived, incoming.getLength(i));
+        Packet *temp = Packet::adopt(&packetPool, incoming.getBuffer(i), incoming.getLength(i));
+        incoming.setBuffer(i, packetPool.allocate(RECVBUFFERSIZE));
+        handleDatagram(index, temp, incoming.getAddress(i), incoming.getAddressLength(i));
+      }
+    }
+    // replies generated by this batch leave in one sendmmsg
+    if (batchSize > 1) {
+      boost::mutex::scoped_lock l(shard.sendMutex);
+      flushShard(shard);
+    }
+	}
+  for (int i = 0; i < incoming.getCapacity(); i++) {
+    packetPool.release(incoming.getBuffer(i), RECVBUFFERSIZE);
+  }
+}
+
+void UDPPlus::handleDatagram(int index, Packet *tempPacket,
+    struct sockaddr *connection, socklen_t connectionLength) {
+  Shard &shard = *shards[index];
+  if (!tempPacket->isValid()) {
+    bump(shard.invalidDatagrams);
+    delete tempPacket;
+    return;
+  }
+	int location = isHostConnected(index, connection, connectionLength);
+	if (location >= 0) {
+		connectionList[location]->handlePacket(tempPacket);
+	}
+	else {
+    UDPPLUS_TRACE("datagram from a host with no connection");
+    boost::mutex::scoped_lock w(waitingMutex);
+		if (waiting == true || acceptQueueing) {
+			if (tempPacket->getField(Packet::SYN)) {
+        int location = findSlot();
+        // with nobody in accept_p the connection queues for try_accept
+        if (!waiting) {
           if (location == -1) {
-            //cerr << "no location found" << endl;
+            bump(shard.refusedConnections);
             delete tempPacket;
-            waitingConnection = NULL;
-            waiting = false;
-            waitingCondition.notify_one();
+            return;
           }
-          // build connection information
-          //cerr << "PACKET RECIEVED: Creating New Connection";
-          waitingConnection = new UDPPlusConnection(this, &connection, connectionLength, bufferSize, tempPacket);
-          connectionList[location] = waitingConnection;
+          UDPPlusConnection *queued = new UDPPlusConnection(this, connection, connectionLength, bufferSize, tempPacket, index);
+          addConnection(location, queued);
+          acceptQueue.push_back(queued);
+          acceptEvent.signal();
+          return;
+        }
+        if (location == -1) {
+          bump(shard.refusedConnections);
+          delete tempPacket;
+          waitingConnection = NULL;
           waiting = false;
-					waitingCondition.notify_one();
-				} else {
-					delete tempPacket;
-				}
+          waitingCondition.notify_one();
+          return;
+        }
+        // build connection information
+        waitingConnection = new UDPPlusConnection(this, connection, connectionLength, bufferSize, tempPacket, index);
+        addConnection(location, waitingConnection);
+        waiting = false;
+				waitingCondition.notify_one();
+			} else {
+        bump(shard.strayDatagrams);
+				delete tempPacket;
 			}
-		}		
+		}
+    else {
+      bump(shard.strayDatagrams);
+      delete tempPacket;
+    }
 	}
 }
 		
-int UDPPlus::isHostConnected(struct sockaddr *connection, socklen_t length) {
-  const sockaddr_in* temp = (sockaddr_in *) connection;
-  
-	for (int i=0; i < max_connections; i++) {
-		if (connectionList[i] != NULL) {
-		  socklen_t tempAddressLength;
-		  const struct sockaddr_in *tempAddress = (const struct sockaddr_in *) connectionList[i]->getSockAddr(tempAddressLength);
-      if ( (temp->sin_port == tempAddress->sin_port) &&
-           (temp->sin_addr.s_addr == tempAddress->sin_addr.s_addr) &&
-           (temp->sin_family == tempAddress->sin_family) )
-      {
- 				return i;
-			}
-		}
-	}
-	return -1;
+int UDPPlus::isHostConnected(int shard, struct sockaddr *connection, socklen_t length) {
+  return shards[shard]->demux.find(connection, length);
 }
 																 
 
 UDPPlusConnection* UDPPlus::conn(const struct sockaddr *info, const socklen_t &infoLength) {
-	if(!bounded)
-	{
-		bounded = true;
-	} else {
-		printf("already bounded");
-		exit(0);
-	}
+  int index;
+  {
+    boost::mutex::scoped_lock s(slotMutex);
+    if(!bounded)
+    {
+      bounded = true;
+      mode = CONNECTED;
+      startListeners();
+    } else if (mode != CONNECTED) {
+      printf("already bounded");
+      exit(0);
+    }
+    // an unbound socket is given an ephemeral port by its first
+    // sendto, so outgoing connections take the shards in turn
+    index = nextShard;
+    nextShard = (nextShard + 1) % numShards;
+  }
   // connect will bind a socket
 	//if (connect(sockfd, info, infoLength) < 0) {
   //  exit(1);
   //}
-  mode = LISTENING;
-  listener = new boost::thread(boost::bind(&UDPPlus::listen, this));
-  boost::mutex::scoped_lock l(waitingMutex);
-  //cerr << "waiting mutex grabbed";
+  boost::mutex::scoped_lock l(shards[index]->mutex);
 	int location = findSlot();
 	if (location == -1) {
-		//cerr << "no location found" ;
 		return NULL;
 	}
   // build connection information
-  //cerr << "creating new connection";
-  UDPPlusConnection *active = new UDPPlusConnection(this, info, infoLength, bufferSize);
-	connectionList[location] = active;
+  UDPPlusConnection *active = new UDPPlusConnection(this, info, infoLength, bufferSize, NULL, index);
+	addConnection(location, active);
 	return active;
 }
 
 int UDPPlus::findSlot() {
-	for(int i = 0; i < max_connections; i++) {
-		if(connectionList[i] == NULL)
-			return i;
-	}
-	return -1;
-}	
+  boost::mutex::scoped_lock s(slotMutex);
+	if (freeSlots.empty())
+		return -1;
+	int location = freeSlots.back();
+	freeSlots.pop_back();
+	return location;
+}
+
+void UDPPlus::lockShards(boost::ptr_vector<boost::mutex::scoped_lock> &locks) {
+  for (int s = 0; s < numShards; s++) {
+    locks.push_back(new boost::mutex::scoped_lock(shards[s]->mutex));
+  }
+}
+
+void UDPPlus::addConnection(int location, UDPPlusConnection *connection) {
+  socklen_t addressLength;
+  const struct sockaddr *address = connection->getSockAddr(addressLength);
+  connectionList[location] = connection;
+  shards[connection->shard]->demux.insert(address, addressLength, location);
+}
 
 void UDPPlus::close_one(UDPPlusConnection *conn) {
   // close single connection
@@ -225,13 +662,53 @@ void UDPPlus::close_all() {
       connectionList[i] = NULL;
 		}
 	}
-	// close the socket
-	close(sockfd);
+	// close the sockets
+	closeSockets();
 }
 
 void UDPPlus::deleteConnection(UDPPlusConnection *connection) {
-  boost::mutex::scoped_lock l(waitingMutex);
-  for( int i = 0; i < max_connections; i++) {
-    if (connectionList[i] == connection) { connectionList[i] = NULL; }
+  Shard &shard = *shards[connection->shard];
+  boost::mutex::scoped_lock l(shard.mutex);
+  socklen_t addressLength;
+  const struct sockaddr *address = connection->getSockAddr(addressLength);
+  int location = shard.demux.find(address, addressLength);
+  if (location >= 0 && connectionList[location] == connection) {
+    connectionList[location] = NULL;
+    shard.demux.erase(address, addressLength);
+    boost::mutex::scoped_lock s(slotMutex);
+    freeSlots.push_back(location);
   }
 }
+
+SocketStats::SocketStats() {
+  datagramsReceived = bytesReceived = receiveCalls = 0;
+  invalidDatagrams = strayDatagrams = refusedConnections = 0;
+  datagramsSent = bytesSent = batchesFlushed = sendErrors = 0;
+  connections = acceptQueued = 0;
+}
+
+void SocketStats::writeJson(ostream &out) const {
+  out << "{\"datagrams_received\":" << datagramsReceived << ",\"bytes_received\":" << bytesReceived
+      << ",\"receive_calls\":" << receiveCalls << ",\"invalid_datagrams\":" << invalidDatagrams
+      << ",\"stray_datagrams\":" << strayDatagrams << ",\"refused_connections\":" << refusedConnections
+      << ",\"datagrams_sent\":" << datagramsSent << ",\"bytes_sent\":" << bytesSent
+      << ",\"batches_flushed\":" << batchesFlushed << ",\"send_errors\":" << sendErrors
+      << ",\"connections\":" << connections
+      << ",\"accept_queued\":" << acceptQueued << "}";
+}
+
+void SocketStats::writePrometheus(ostream &out, const string &labels) const {
+  string braces = labels.empty() ? "" : "{" + labels + "}";
+  out << "udpplus_socket_datagrams_received_total" << braces << " " << datagramsReceived << "\n"
+      << "udpplus_socket_bytes_received_total" << braces << " " << bytesReceived << "\n"
+      << "udpplus_socket_receive_calls_total" << braces << " " << receiveCalls << "\n"
+      << "udpplus_socket_invalid_datagrams_total" << braces << " " << invalidDatagrams << "\n"
+      << "udpplus_socket_stray_datagrams_total" << braces << " " << strayDatagrams << "\n"
+      << "udpplus_socket_refused_connections_total" << braces << " " << refusedConnections << "\n"
+      << "udpplus_socket_datagrams_sent_total" << braces << " " << datagramsSent << "\n"
+      << "udpplus_socket_bytes_sent_total" << braces << " " << bytesSent << "\n"
+      << "udpplus_socket_batches_flushed_total" << braces << " " << batchesFlushed << "\n"
+      << "udpplus_socket_send_errors_total" << braces << " " << sendErrors << "\n"
+      << "udpplus_socket_connections" << braces << " " << connections << "\n"
+      << "udpplus_socket_accept_queued" << braces << " " << acceptQueued << "\n";
+}
@@ -16,6 +16,16 @@
 
 #include "utility.h"
 #include "Packet.h"
+#include "ConnectionDemux.h"
+#include "DatagramBatch.h"
+#include "DatagramTransport.h"
+#include "PacketPool.h"
+#include "TimerWheel.h"
+#include "EventNotifier.h"
+#include "Task.h"
+
+#include <boost/atomic.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
 
 class UDPPlusConnection;
 
@@ -25,12 +35,41 @@ class UDPPlusConnection;
 
 enum Mode { LISTENING, CONNECTED };
 
+// snapshot of a UDPPlus object's socket counters, summed over
+// its shards, and how many connections it holds
+struct SocketStats {
+  SocketStats();
+
+  uint64_t datagramsReceived;
+  uint64_t bytesReceived;
+  uint64_t receiveCalls;      // recvmmsg or recvfrom calls by the listeners
+  uint64_t invalidDatagrams;  // too short for the header they claim
+  uint64_t strayDatagrams;    // from unknown hosts, not opening a connection
+  uint64_t refusedConnections; // no slot was free
+  uint64_t datagramsSent;
+  uint64_t bytesSent;
+  uint64_t batchesFlushed;    // sendmmsg batches, when batching
+  uint64_t sendErrors;        // datagrams dropped, the socket refused them
+  int connections;
+  int acceptQueued;           // waiting for try_accept
+
+  // one JSON object
+  void writeJson(ostream &out) const;
+  // Prometheus text format, udpplus_socket_ series
+  // labels are added to every series, without braces
+  void writePrometheus(ostream &out, const string &labels = "") const;
+};
+
+enum StatsFormat { JSON, PROMETHEUS };
+
 class UDPPlus {
 public:
   
   // initializes all data members and connectionList
   // also creates socket to be used in all connections
-  UDPPlus(int max_connection = 10, int bufferSize = 1024);
+  // shards > 1 opens that many SO_REUSEPORT sockets, each with
+  // its own listener thread, all sharing max_connection slots
+  UDPPlus(int max_connection = 10, int bufferSize = 1024, int shards = 1);
   
   // closes all open UDPPlusConnection objects in connectionList
   // deallocates memory
@@ -39,8 +78,29 @@ public:
   // binds a socket to be used for connection
   // builds a UDPPlusConnection object and stores in connectionList
   // returns pointer to UDPPlusconnection object
+  // may be called again for more connections, each on the next
+  // shard in turn, but not after bind_p
   UDPPlusConnection* conn(const struct sockaddr*, const socklen_t&);
 	
+  // receive and send up to batchSize datagrams per system call
+  // queued datagrams are sent once the batch fills, the listener
+  // finishes a receive batch, or flushDeadline passes
+  // must be called before bind_p or conn
+  void setBatching(int batchSize, time_duration flushDeadline = microseconds(500));
+
+  // offer the extended header, 32 bit sequence numbers and a
+  // scaled receive window, in every handshake, on by default
+  // connections fall back to the classic header with peers
+  // that do not offer it back
+  // must be called before bind_p or conn
+  void setExtendedHeaders(bool enabled);
+
+  // sends and receives through transport instead of a UDP
+  // socket, such as an endpoint of a NetworkEmulator
+  // the UDPPlus object takes ownership of transport
+  // must be called before bind_p or conn, with one shard
+  void setTransport(DatagramTransport *transport);
+
   // binds a port to be listened to
   // starts a listener thread to listen for incoming packets
 	void bind_p(const struct sockaddr*, const socklen_t&);
@@ -49,6 +109,30 @@ public:
   // adds new connection to the connectionList
 	UDPPlusConnection* accept_p();
 
+  // returns a connection that has already arrived, or NULL with
+  // errno set to EAGAIN instead of waiting for one
+  // new connections are only taken while accept_p waits or once
+  // getEventFd has been called, then they queue for try_accept
+  UDPPlusConnection* try_accept();
+
+  // descriptor for select, poll or epoll, readable while
+  // try_accept may have a connection.  it stays readable until
+  // try_accept returns EAGAIN, the application never reads it
+  int getEventFd();
+
+  // socket counters and connection count
+  SocketStats getStats();
+  // writes getStats and the stats of every connection, each
+  // labelled with its peer's address, as one JSON object or
+  // one Prometheus scrape
+  void writeStats(ostream &out, StatsFormat format);
+
+#ifdef UDPPLUS_COROUTINES
+  // coroutine version of accept_p, for sessions run by an Executor
+  // suspends the session until a connection arrives
+  Task<UDPPlusConnection*> async_accept();
+#endif
+
 	// methods to close UDP+ connections
 	// close will close a single connection object
 	// close_all will close all open connections
@@ -58,40 +142,150 @@ public:
 
 
 private:
+
+  // a socket, its listener thread and the connections the
+  // kernel steers to it.  the SO_REUSEPORT hash keeps each
+  // peer on one shard, so shards never share a connection
+  struct Shard {
+    Shard(int capacity);
+    ~Shard();
+
+    int sockfd;     // -1 once a transport replaces it
+    boost::thread *listener;
+    // guards demux, packet delivery and the connectionList slots
+    // of this shard's connections
+    boost::mutex mutex;
+    ConnectionDemux demux;
+
+    // guards outgoing and firstQueued
+    boost::mutex sendMutex;
+    // datagrams waiting for sendmmsg, NULL when not batching
+    DatagramBatch *outgoing;
+    ptime firstQueued;
+
+    // counters for getStats, the listener thread is the only
+    // writer of the receive side ones
+    boost::atomic<uint64_t> datagramsReceived;
+    boost::atomic<uint64_t> bytesReceived;
+    boost::atomic<uint64_t> receiveCalls;
+    boost::atomic<uint64_t> invalidDatagrams;
+    boost::atomic<uint64_t> strayDatagrams;
+    boost::atomic<uint64_t> refusedConnections;
+    boost::atomic<uint64_t> datagramsSent;
+    boost::atomic<uint64_t> bytesSent;
+    boost::atomic<uint64_t> batchesFlushed;
+    boost::atomic<uint64_t> sendErrors;
+  };
+
+  // largest datagram the listener will receive
+  const static int RECVBUFFERSIZE = 5000;
+  // most payload segments a single sendv may pass
+  const static int MAXSEGMENTS = 64;
   
   // listens to binded port for incoming data
   // when incoming data is received, check if the host is known (isHostConnected)
   // if host is already connected, process the incoming packet
   // if host is not connected, check SYN bits and process connection
-  void listen();
+  void listen(int shard);
+
+  // routes one received packet to its connection
+  // or to accept_p if it opens a new connection
+  // takes ownership of the packet
+  // expects the shard mutex to be held
+  void handleDatagram(int shard, Packet *packet,
+      struct sockaddr *connection, socklen_t connectionLength);
+
+  // sends a packet's header and caller owned payload segments
+  // with one sendmsg, without gathering them into one buffer
+  void sendScattered(Shard &shard, struct sockaddr *connection, socklen_t len, Packet *p);
+
+  // sends one datagram through the shard's socket or the transport
+  // a send refused for now is retried, then the datagram is
+  // dropped and counted like a packet lost on the path
+  void sendDatagram(Shard &shard, struct sockaddr *connection, socklen_t len,
+      struct iovec *vectors, int count);
+  // counts and logs datagrams a send dropped, errno says why
+  void droppedSends(Shard &shard, int count);
+
+  // sends a shard's queued datagrams
+  // expects the shard's sendMutex to be held
+  void flushShard(Shard &shard);
+
+  // this method is threaded
+  // sends batches that have waited past flushDeadline
+  void flusher();
+
+  // starts one listener thread per shard
+  void startListeners();
+
+  // shuts down and closes every shard socket
+  // wakes the listener threads blocked in recvfrom
+  void closeSockets();
 	
-  // sends packet to given sockaddr
-  void send_p(struct sockaddr *connection, socklen_t len, Packet*);
+  // sends packet to given sockaddr through the shard's socket
+  void send_p(struct sockaddr *connection, socklen_t len, Packet*, int shard = 0);
 
-  // searches connectionList for an open indicie
+  // takes an open indicie off the free slot list, any shard
+  // may take any slot
   // returns the indicies location if found
   // returns -1 if no open slot is available
 	int findSlot();
+  // takes every shard mutex, in order, to walk connectionList
+  void lockShards(boost::ptr_vector<boost::mutex::scoped_lock> &locks);
+
+  // stores a connection in the given slot and registers
+  // its remote address with the shard's demux table
+  void addConnection(int location, UDPPlusConnection *connection);
     
   // checks if an incoming packet is sent from a known host
   // if returns -1, host was not found and is new
-	int isHostConnected(struct sockaddr *connection, socklen_t length);
+	int isHostConnected(int shard, struct sockaddr *connection, socklen_t length);
   void deleteConnection(UDPPlusConnection *connection);
 
   // array of all UDPPlusConnections
 	UDPPlusConnection **connectionList;
+  vector<Shard*> shards;
+  int numShards;
+  // guards freeSlots, nextShard and the first conn, taken after
+  // a shard mutex
+  boost::mutex slotMutex;
+  vector<int> freeSlots;
+  int nextShard;        // shard of the next outgoing connection
+  // buffers for every packet sent or received through this object
+  // slabs hold the largest datagram, or a small control packet
+  // a chunk holds bufferSize slabs of one size
+  PacketPool packetPool;
+  // drives retransmission, delayed ACKs and idle expiry
+  // for every connection
+  TimerWheel timers;
   
   Mode mode;
-	int sockfd;
 	int max_connections;
 	int bufferSize;
-	boost::thread *listener;
 	bool bounded;
 	bool waiting;
+	// guards the accept_p handoff (waiting, waitingConnection)
+	// and acceptQueue
 	boost::mutex waitingMutex;
 	boost::condition_variable waitingCondition;
 	UDPPlusConnection *waitingConnection;
-  bool listenerDone;
+  // connections taken with nobody in accept_p, once acceptEvent is open
+  deque<UDPPlusConnection*> acceptQueue;
+  EventNotifier acceptEvent;
+  bool acceptQueueing;
+  boost::atomic<bool> listenerDone;
+
+  int batchSize;
+  time_duration flushDeadline;
+  boost::thread *flushThread;
+  // guards flushPending, wakes the flusher thread
+  boost::mutex flushMutex;
+  boost::condition_variable flushCondition;
+  bool flushPending;
+
+  bool extendedHeaders;
+  // NULL while the shard sockets carry the datagrams
+  DatagramTransport *transport;
 	
 	// UDPPlusConnecion object are friended so that
 	// these objects can call private UDPPlus methods
@@ -7,15 +7,107 @@
 
 #include "UDPPlusConnection.h"
 #include "UDPPlus.h"
+#include "NewReno.h"
+#include "Executor.h"
+#include "Logger.h"
+
+// retransmission timeout bounds, see RFC 6298
+// the floor is far below TCP's one second so LAN losses recover quickly
+const time_duration INITIALRTO = milliseconds(1000);
+const time_duration MINRTO = milliseconds(10);
+const time_duration MAXRTO = milliseconds(60000);
+const time_duration CLOCKGRANULARITY = milliseconds(1);
+// a held back ack must reach the peer well before its MINRTO
+// or the peer retransmits a packet that already arrived
+const time_duration DELAYEDACK = milliseconds(5);
+const int DELAYEDACKPACKETS = 2;
+const int QUICKACKS = 8;
+
+// an ethernet frame less the IP and UDP headers, tried first
+const size_t DEFAULTMTU = 1472;
+// path MTU discovery, see RFC 8899
+// every path is assumed to carry BASEMTU, a probe unanswered
+// MAXPROBES times is too big, and the search stops once the
+// sizes left to try are closer than MTUSEARCHSTEP
+const size_t BASEMTU = 1200;
+const int MAXPROBES = 3;
+const size_t MTUSEARCHSTEP = 16;
+// a path that may have grown is searched again this often
+const time_duration MTURAISE = minutes(10);
+// longest fragmented message a receiver will reassemble
+const uint32_t MAXMESSAGESIZE = 64 * 1024 * 1024;
+
+// pacing rate as a multiple of cwnd per srtt, as in Linux
+// slow start paces faster so the window can still double
+const double SLOWSTARTPACEGAIN = 2.0;
+const double PACEGAIN = 1.2;
+// how far behind schedule pacing may catch up, one wheel tick
+const time_duration PACESLACK = milliseconds(1);
+
+// an extended SYN carries the sender's receive window, in packets
+// shifted right by the scale, after the fixed header
+const unsigned HANDSHAKEOPTIONSIZE = 3;
+const int MAXWINDOWSCALE = 15;
+
+// sacked packets above a hole before it is considered lost
+const int DUPTHRESH = 3;
+// a SACK block is a start and end sequence number, 16 blocks of
+// the extended header's 8 bytes still fit the header length byte
+const int MAXSACKBLOCKS = 16;
+
+// reads and writes a sequence number of the given byte width
+static uint32_t readSequence(const uint8_t *location, int width) {
+  if (width == 4) {
+    uint32_t number;
+    memcpy(&number, location, sizeof(number));
+    return ntohl(number);
+  }
+  uint16_t number;
+  memcpy(&number, location, sizeof(number));
+  return ntohs(number);
+}
+
+static void writeSequence(uint32_t seq, uint8_t *location, int width) {
+  if (width == 4) {
+    uint32_t number = htonl(seq);
+    memcpy(location, &number, sizeof(number));
+    return;
+  }
+  uint16_t number = htons(seq);
+  memcpy(location, &number, sizeof(number));
+}
 
 UDPPlusConnection::UDPPlusConnection(UDPPlus *mainHandler,
     const struct sockaddr *remote,
     const socklen_t &remoteSize,
     int &bufferSize,
-    Packet *incomingConnection) {
+    Packet *incomingConnection,
+    int shard) : delivered(bufferSize), submitted(bufferSize) {
 
   this->mainHandler = mainHandler;
-  ackWaiting = 0;
+  this->shard = shard;
+  this->packetPool = &mainHandler->packetPool;
+  ackPending = 0;
+  quickAcksLeft = ackPolicy.quickAcks;
+  timeout = milliseconds(1000);
+  maximumTimeout = milliseconds(180000);
+  srtt = rttvar = minRtt = time_duration(0, 0, 0);
+  rto = INITIALRTO;
+  rttValid = false;
+  rtoBackoff = 0;
+  inRecovery = false;
+  timedOut = false;
+  recoverSeq = 0;
+  probeBackoff = 0;
+  highRxt = 0;
+  dupAcks = 0;
+  pacing = true;
+  unsent = 0;
+  paceEntry.callback = boost::bind(&UDPPlusConnection::pace, this);
+  idleSince = microsec_clock::universal_time();
+  timerDone = false;
+  timerDeadline = idleSince;
+  timerEntry.callback = boost::bind(&UDPPlusConnection::timer, this);
 
   memcpy(&remoteAddress, remote, remoteSize);
   this->remoteAddressLength = remoteSize;
@@ -23,14 +115,48 @@ UDPPlusConnection::UDPPlusConnection(UDPPlus *mainHandler,
   this->inBufferSize = bufferSize;
   inBufferBegin = 0;
   outBufferBegin = 0;
+  extended = 0;
   newAckNum = 0;
   newSeqNum = 0;
   inBufferDelta = 0;
   outItems = 0;
-  numAck = 0;
   lastAckRecv = 0;
   currentState = LISTEN;
-  maxAckNumber = -1;
+  finReceived = false;
+  maxAckNumber = 0;
+
+  // until the handshake says otherwise
+  maxInFlight = (outBufferSize < (int) serial.maxWindow()) ? outBufferSize : serial.maxWindow();
+  peerWindow = maxInFlight;
+  peerScale = 0;
+  windowScale = 0;
+  while ((inBufferSize >> windowScale) > 0xFFFF) {
+    windowScale++;
+  }
+  advertised = inBufferSize;
+  coalesceMtu = 0;
+  inOffset = 0;
+  mtu = BASEMTU;
+  discovering = true;
+  mtuCeiling = UDPPlus::RECVBUFFERSIZE;
+  mtuProbe = 0;
+  mtuProbes = 0;
+  mtuProbeTime = idleSince;
+  sendingFragments = false;
+  queuedOffset = 0;
+  gathering = false;
+  gathered = NULL;
+  gatheredTotal = 0;
+  gatheredLength = 0;
+  overflowed = 0;
+  returned = NULL;
+  readerSleeping = false;
+  submissions = 0;
+  submitLimit = 0;
+  submitHeader = 0;
+  sendersWaiting = 0;
+  congestion = new NewReno();
+  congestion->setMaxWindow(maxInFlight);
 
   inBuffer = new Packet*[inBufferSize];
   outBuffer = new Packet*[outBufferSize];
@@ -44,28 +170,39 @@ UDPPlusConnection::UDPPlusConnection(UDPPlus *mainHandler,
   if (incomingConnection == NULL) {
     srand(time(NULL));
     newSeqNum = rand() % Packet::MAXSIZE;
-    //cout << newSeqNum;
-    Packet *current = new Packet(Packet::SYN, newSeqNum++, 0);
-    current->print();
+    if (mainHandler->extendedHeaders) {
+      // offered, readHandshake settles it once the SYN-ACK arrives
+      extended = Packet::EXT;
+      serial = SerialNumber(32);
+      newSeqNum = (newSeqNum << 16) ^ (rand() % Packet::MAXSIZE);
+    }
+    Packet *current = handshakePacket(Packet::SYN, nextSeq(), 0);
     outBuffer[(outBufferBegin + outItems) % outBufferSize] = current;
     outItems++;
     send_packet(current);
     currentState = SYN_SENT;
   }
   else {
-    incomingConnection->print();
     handlePacket(incomingConnection);
   }
 
-  clock = new boost::thread(boost::bind(&UDPPlusConnection::timer, this));
-  timerCondition.notify_one();
-  
+  wakeTimer();
 }
 
 UDPPlusConnection::~UDPPlusConnection() {
   closeConnection();
-  clock->join();  //wait for clock to be destroyed.
-  //cout << "Destroying Connection";
+  {
+    // wait for the timer to see the connection closed
+    boost::mutex::scoped_lock l(sharedMutex);
+    while (!timerDone) {
+      closeCondition.wait(l);
+    }
+  }
+  mainHandler->timers.cancel(&timerEntry);
+  mainHandler->timers.cancel(&paceEntry);
+  // unreachable from the listener and UDPPlus::writeStats
+  // before anything is freed
+  mainHandler->deleteConnection(this);
   for (int i = 0; i < inBufferSize; i++) {
     if ( inBuffer[i] != NULL) {
       delete inBuffer[i];
@@ -76,103 +213,536 @@ UDPPlusConnection::~UDPPlusConnection() {
       delete outBuffer[i];
     }
   }
-  delete inBuffer;
-  delete outBuffer;
-  
-  mainHandler->deleteConnection(this);
+  Packet *left;
+  while (delivered.pop(left)) {
+    delete left;
+  }
+  while (submitted.pop(left)) {
+    delete left;
+  }
+  for (size_t i = 0; i < overflow.size(); i++) {
+    delete overflow[i];
+  }
+  delete returned;
+  delete[] inBuffer;
+  delete[] outBuffer;
+  delete[] gathered;
+  delete congestion;
 }
 
 void UDPPlusConnection::closeConnection() {
   boost::mutex::scoped_lock l(sharedMutex);
   if (currentState == FIN_WAIT || currentState == LAST_ACK || currentState == CLOSED || currentState == TIME_WAIT) {
-    //cout << "Already Closing" << endl;
     return; //already closing;
   }
   
-  cout << "Trying to caputure close lock" << endl;
-  cerr << "closing connection" << endl;
+  // messages still waiting to be coalesced or submitted, or a
+  // message still being fragmented, go before the FIN, and the
+  // FIN needs a slot in the out buffer like any packet
+  if (!coalesced.empty() && !flushCoalesced(l)) {
+    return;
+  }
+  while ((sendingFragments || !submitQueued() || outItems >= outBufferSize) &&
+      (currentState == ESTABLISHED || currentState == CLOSE_WAIT)) {
+    waitForSend(l);
+  }
+  if (currentState == FIN_WAIT || currentState == LAST_ACK || currentState == CLOSED || currentState == TIME_WAIT) {
+    return;
+  }
+  
+  UDPPLUS_DEBUG("%p closing", (void *) this);
   if (currentState == CLOSE_WAIT) {
     currentState = LAST_ACK;
   }
   else {
     currentState = FIN_WAIT;
   }
+  updateSubmitLimit();
   
-  Packet *temp = new Packet(Packet::FIN | Packet::ACK, newSeqNum++, newAckNum);
-  outBuffer[(outBufferBegin + outItems) % outBufferSize] = temp;
-  outItems++;
-  send_packet(temp);
+  Packet *temp = new Packet(packetPool, Packet::FIN | Packet::ACK | extended, nextSeq(), newAckNum);
+  transmit(temp);
 }
 
 void UDPPlusConnection::timer() {
-  bool done = false;
-  timeout = milliseconds(1000);
-  maximumTimeout = milliseconds(180000);
-  time_duration tempTimeout;
-  time_duration minTimeout = maximumTimeout; // 3 minutes
-  bool connectionTimeout = false;
-  int connectionTimeoutCount = 0;
-  
-  
-  boost::mutex::scoped_lock l(sharedMutex);  // change to timerMutex
-  while(!done) {
-    cerr << "Timer event occurred" << to_simple_string(minTimeout) << endl;
-    bool conditionNotified = timerCondition.timed_wait(l, minTimeout);
-    ptime currentTime(microsec_clock::universal_time());
-    minTimeout = maximumTimeout;
-
-    if (currentState == CLOSED) { break; }
-    
-    if (connectionTimeout == true && conditionNotified == false) {
-      connectionTimeoutCount++;
-      if (connectionTimeoutCount >= 2) {
-        currentState = CLOSED;
-        break;
+  boost::mutex::scoped_lock l(sharedMutex);
+  if (timerDone) { return; }
+
+  ptime currentTime(microsec_clock::universal_time());
+  ptime nextWake = currentTime + maximumTimeout; // 3 minutes
+  bool pending = false;
+
+  if (currentState == CLOSED) { stopTimer(); return; }
+
+  // a FIN still unacked is resent below like any packet
+  if (currentState == LAST_ACK && outItems == 0) {
+    currentState = CLOSED;
+    stopTimer();
+    return;
+  }
+
+  // a head packet still waiting on pacing has nothing to retransmit
+  if (outBuffer[outBufferBegin] != NULL && outBuffer[outBufferBegin]->sendCount > 0) {
+    if (outBuffer[outBufferBegin]->getTime() + rto < currentTime) {
+      counters.timeouts++;
+      congestion->onTimeout(outItems);
+      // whatever was in flight is presumed lost too, it is resent
+      // from the head as slow start opens the window, RFC 5681
+      inRecovery = false;
+      timedOut = true;
+      timedOutAt = currentTime;
+      recoverSeq = newSeqNum;
+      backoffRto();
+      // the peer may have discarded what it sacked, RFC 2018
+      scoreboard.clear();
+      dupAcks = 0;
+      highRxt = serial.add(outBuffer[outBufferBegin]->getSeqNumber(), 1);
+      // the path may have stopped carrying packets this big, fall
+      // back and search again, packets already built keep their size
+      if (discovering && rtoBackoff >= MAXPROBES && mtu > BASEMTU &&
+          outBuffer[outBufferBegin]->getLength() > BASEMTU) {
+        mtu = BASEMTU;
+        mtuCeiling = UDPPlus::RECVBUFFERSIZE;
+        mtuProbe = 0;
+        mtuProbeTime = currentTime;
+        updateSubmitLimit();
       }
+      send_packet(outBuffer[outBufferBegin]);
+    }
+    ptime retransmit = outBuffer[outBufferBegin]->getTime() + rto;
+    nextWake = (nextWake < retransmit) ? nextWake : retransmit;
+    pending = true;
+  }
+  if (ackPending > 0) {
+    if (ackTimestamp + ackPolicy.delay <= currentTime) {
+      sendAck();
+    } else {
+      ptime delayedAck = ackTimestamp + ackPolicy.delay;
+      nextWake = (nextWake < delayedAck) ? nextWake : delayedAck;
+      pending = true;
     }
-    
-    connectionTimeout = true;
-    
+  }
 
-    if (currentState == LAST_ACK) {
-      closeCondition.notify_all();
-      currentState = CLOSED;
-      break;
+  if (!coalesced.empty()) {
+    flushDue();
+  }
+  // once the delay is up what is left waits for the window, the
+  // acks and window updates that open it flush it, waking for a
+  // deadline already passed would only spin
+  if (!coalesced.empty()) {
+    if (currentTime < coalesceDeadline) {
+      nextWake = (nextWake < coalesceDeadline) ? nextWake : coalesceDeadline;
     }
-    else {
-      if (outBuffer[outBufferBegin] != NULL) {
-        if (outBuffer[outBufferBegin]->getTime() + timeout < currentTime) {
-          send_packet(outBuffer[outBufferBegin]);
-        }
-        tempTimeout = outBuffer[outBufferBegin]->getTime() + timeout - currentTime;
-        minTimeout = (minTimeout < tempTimeout) ? minTimeout : tempTimeout;
-        connectionTimeout = false;
-        connectionTimeoutCount = 0;
-      }
-      if (ackWaiting == 1) {
-        if (ackTimestamp + timeout < currentTime) {        
-          Packet temp = Packet(Packet::ACK, lowestValidSeq(), newAckNum);
-          mainHandler->send_p(&remoteAddress, remoteAddressLength, &temp);
-          ackWaiting = 0;
-        } else {
-          tempTimeout = ackTimestamp + timeout - currentTime;
-          minTimeout = (minTimeout < tempTimeout) ? minTimeout : tempTimeout;
-          connectionTimeout = false;
-          connectionTimeoutCount = 0;
-        }
+    pending = true;
+  }
+
+  // the peer closed its window with nothing of ours in flight
+  // to carry the update that reopens it, so ask for one
+  if (extended && peerWindow == 0 && outItems == 0 &&
+      (currentState == ESTABLISHED || currentState == CLOSE_WAIT)) {
+    if (probeTime <= currentTime) {
+      sendProbe();
+      probeBackoff++;
+      time_duration wait = rto;
+      for (int i = 0; i < probeBackoff && wait < MAXRTO; i++) {
+        wait = wait * 2;
       }
+      probeTime = currentTime + ((wait < MAXRTO) ? wait : MAXRTO);
+    }
+    nextWake = (nextWake < probeTime) ? nextWake : probeTime;
+    pending = true;
+  }
+
+  // probes wait for a round trip estimate, which also means the
+  // peer is established, and stop while packets are timing out
+  if (discovering && currentState == ESTABLISHED && rttValid && rtoBackoff == 0) {
+    ptime nextSearch = searchMtu(currentTime);
+    nextWake = (nextWake < nextSearch) ? nextWake : nextSearch;
+  }
+
+  if (currentState == CLOSED || currentState == TIME_WAIT) {
+    currentState = CLOSED;
+    stopTimer();
+    return;
+  }
+
+  // two full maximumTimeout periods with nothing to send or
+  // acknowledge and the peer is considered gone
+  if (pending) {
+    idleSince = currentTime;
+  }
+  else if (currentTime - idleSince >= maximumTimeout * 2) {
+    currentState = CLOSED;
+    stopTimer();
+    return;
+  }
+  timerDeadline = nextWake;
+  mainHandler->timers.schedule(&timerEntry, nextWake);
+}
+
+ConnectionStats UDPPlusConnection::getStats() {
+  boost::mutex::scoped_lock l(sharedMutex);
+  ConnectionStats stats(counters);
+  stats.srtt = srtt;
+  stats.rttvar = rttvar;
+  stats.rto = rto;
+  stats.rttValid = rttValid;
+  stats.cwnd = congestion->getCwnd();
+  stats.ssthresh = congestion->getSsthresh();
+  stats.mtu = mtu;
+  stats.inFlight = outItems - unsent;
+  stats.unsent = unsent;
+  stats.submitted = submissions;
+  stats.undelivered = (int) delivered.read_available() + overflowed;
+  stats.outOfOrder = inBufferDelta;
+  stats.recvDelay = recvDelay;
+  return stats;
+}
+
+void UDPPlusConnection::setCongestionControl(CongestionControl *algorithm) {
+  boost::mutex::scoped_lock l(sharedMutex);
+  delete congestion;
+  congestion = algorithm;
+  congestion->setMaxWindow(maxInFlight);
+  wakeSenders();
+}
+
+void UDPPlusConnection::congestionAck(int acked, uint32_t ackNumber) {
+  if (acked <= 0) {
+    return;
+  }
+  // an ack past what was resent since the timeout, or one back
+  // sooner than any round trip the path has carried, was for
+  // packets that arrived the first time.  The flight was not lost
+  // after all, only the holes SACK shows are resent, RFC 5682
+  if (timedOut && (serial.lessEqual(recoverSeq, ackNumber) || serial.lessThan(highRxt, ackNumber) ||
+      (rttValid && microsec_clock::universal_time() - timedOutAt < minRtt / 2))) {
+    timedOut = false;
+  }
+  if (inRecovery) {
+    if (serial.lessEqual(recoverSeq, ackNumber)) {
+      inRecovery = false;
+    }
+    else {
+      // partial ack, recoverLosses resends the next hole
+      return;
+    }
+  }
+  congestion->onAck(acked, rttValid ? srtt : rto);
+}
+
+void UDPPlusConnection::congestionLoss() {
+  // the timeout already cut the window for everything sent before it
+  if (inRecovery || timedOut) {
+    return;
+  }
+  inRecovery = true;
+  recoverSeq = newSeqNum;
+  congestion->onLoss(outItems);
+}
+
+void UDPPlusConnection::setAckPolicy(const AckPolicy &policy) {
+  boost::mutex::scoped_lock l(sharedMutex);
+  ackPolicy = policy;
+  if (ackPolicy.packets < 1) {
+    ackPolicy.packets = 1;
+  }
+  if (ackPolicy.delay.is_negative()) {
+    ackPolicy.delay = time_duration(0, 0, 0);
+  }
+  if (ackPolicy.quickAcks < 0) {
+    ackPolicy.quickAcks = 0;
+  }
+  quickAcksLeft = (quickAcksLeft < ackPolicy.quickAcks) ? quickAcksLeft : ackPolicy.quickAcks;
+  // a shorter delay or smaller count may already be due
+  if (ackPending > 0) {
+    wakeTimer();
+  }
+}
+
+void UDPPlusConnection::setPacing(bool enabled) {
+  boost::mutex::scoped_lock l(sharedMutex);
+  pacing = enabled;
+  if (!pacing && unsent > 0) {
+    nextDeparture = ptime();
+    mainHandler->timers.wake(&paceEntry);
+  }
+}
+
+void UDPPlusConnection::transmit(Packet *packet) {
+  outBuffer[(outBufferBegin + outItems) % outBufferSize] = packet;
+  outItems++;
+  if (unsent == 0 && !paceLater(microsec_clock::universal_time())) {
+    send_packet(packet);
+    return;
+  }
+  if (unsent++ == 0) {
+    mainHandler->timers.schedule(&paceEntry, nextDeparture);
+  }
+}
+
+void UDPPlusConnection::pace() {
+  boost::mutex::scoped_lock l(sharedMutex);
+  if (timerDone) { return; }
+
+  ptime now(microsec_clock::universal_time());
+  while (unsent > 0 && !paceLater(now)) {
+    Packet *packet = outBuffer[(outBufferBegin + outItems - unsent) % outBufferSize];
+    unsent--;
+    send_packet(packet);
+  }
+  if (unsent > 0) {
+    mainHandler->timers.schedule(&paceEntry, nextDeparture);
+  }
+}
+
+bool UDPPlusConnection::paceLater(ptime now) {
+  if (!pacing || !rttValid || nextDeparture.is_not_a_date_time()) {
+    nextDeparture = now;
+  }
+  if (now < nextDeparture) {
+    return true;
+  }
+  // departures missed while the wheel was between ticks still go out,
+  // but idle time beyond that is not banked, a sender that paused
+  // does not get to burst when it resumes
+  if (nextDeparture + PACESLACK < now) {
+    nextDeparture = now;
+  }
+  nextDeparture += paceInterval();
+  return false;
+}
+
+time_duration UDPPlusConnection::paceInterval() {
+  if (!pacing || !rttValid) {
+    return time_duration(0, 0, 0);
+  }
+  double gain = (congestion->getCwnd() < congestion->getSsthresh()) ? SLOWSTARTPACEGAIN : PACEGAIN;
+  double packetsPerRtt = congestion->getCwnd() * gain;
+  return microseconds((int64_t) (srtt.total_microseconds() / packetsPerRtt));
+}
+
+int UDPPlusConnection::sendWindow() {
+  int window = congestion->getWindow();
+  window = (window < maxInFlight) ? window : maxInFlight;
+  return (window < peerWindow) ? window : peerWindow;
+}
+
+int UDPPlusConnection::receiveWindow() {
+  // read without the reader's lock the count may lag behind
+  // what it has taken, never ahead
+  int window = inBufferSize - (int) (delivered.read_available() + overflowed);
+  return (window > 0) ? window : 0;
+}
+
+bool UDPPlusConnection::readWindow(Packet *packet) {
+  if (!extended || serial.lessThan(packet->getAckNumber(), lastAckRecv)) {
+    return false;
+  }
+  int window = (int) packet->getWindow() << peerScale;
+  if (window == peerWindow) {
+    return false;
+  }
+  if (window == 0) {
+    probeBackoff = 0;
+    probeTime = microsec_clock::universal_time() + rto;
+    armTimer(probeTime);
+  }
+  else if (window > peerWindow) {
+    wakeSenders();
+  }
+  peerWindow = window;
+  return true;
+}
+
+void UDPPlusConnection::sendProbe() {
+  // empty DATA|ACK at newSeqNum - 1, already acked, so the
+  // peer drops it and answers with an ack carrying its window
+  Packet probe = Packet(packetPool, Packet::DATA | Packet::ACK | extended, serial.add(newSeqNum, -1), newAckNum);
+  output(&probe);
+}
+
+ptime UDPPlusConnection::searchMtu(ptime now) {
+  if (now < mtuProbeTime) {
+    return mtuProbeTime;
+  }
+  if (mtuProbe == 0 || mtuProbes >= MAXPROBES) {
+    // a probe never answered was too big for the path
+    if (mtuProbe != 0) {
+      mtuCeiling = mtuProbe - 1;
+    }
+    nextMtuProbe(now);
+    if (mtuProbe == 0) {
+      return mtuProbeTime;
+    }
+  }
+  // sequence numbers are untouched, so a lost probe
+  // is never resent as data or taken for congestion
+  uint8_t field = Packet::ACK | Packet::PROBE | extended;
+  size_t header = extended ? Packet::EXTHEADERSIZE : Packet::DEFAULTHEADERSIZE;
+  Packet probe = Packet(packetPool, field, newSeqNum, newAckNum, NULL, mtuProbe - header);
+  output(&probe);
+  mtuProbes++;
+  mtuProbeTime = now + rto;
+  return mtuProbeTime;
+}
+
+void UDPPlusConnection::nextMtuProbe(ptime now) {
+  mtuProbe = 0;
+  mtuProbes = 0;
+  if (mtuCeiling < mtu + MTUSEARCHSTEP) {
+    // close enough, the path is searched again later in case it grew
+    mtuCeiling = UDPPlus::RECVBUFFERSIZE;
+    mtuProbeTime = now + MTURAISE;
+    return;
+  }
+  // most paths are ethernet, try that before halving the range
+  if (mtu < DEFAULTMTU && DEFAULTMTU <= mtuCeiling) {
+    mtuProbe = DEFAULTMTU;
+  }
+  else {
+    mtuProbe = mtu + (mtuCeiling - mtu + 1) / 2;
+  }
+  mtuProbeTime = now;
+}
+
+void UDPPlusConnection::handleMtuProbe(Packet *currentPacket) {
+  if (currentPacket->getField(Packet::DATA)) {
+    return;
+  }
+  if (currentPacket->getField(Packet::PROBE)) {
+    uint16_t length = htons(currentPacket->getLength());
+    Packet reply = Packet(packetPool, Packet::ACK | Packet::PROBEREPLY | extended, newSeqNum, newAckNum,
+        &length, sizeof(length));
+    output(&reply);
+  }
+  else if (currentPacket->getField(Packet::PROBEREPLY) &&
+      currentPacket->getPayloadLength() >= Packet::PROBEREPLYSIZE) {
+    uint16_t length;
+    memcpy(&length, currentPacket->getPayload(), sizeof(length));
+    if (discovering && mtuProbe != 0 && ntohs(length) == mtuProbe) {
+      mtu = mtuProbe;
+      nextMtuProbe(microsec_clock::universal_time());
+      wakeTimer();
     }
-    if (currentState == TIME_WAIT) {
-      connectionTimeout = false;
-      minTimeout = timeout;
-      if (conditionNotified = false) { cerr << "in timewait" << endl; continue; }
-      else { currentState = CLOSED; break; }
+  }
+}
+
+Packet* UDPPlusConnection::handshakePacket(uint8_t field, uint32_t seqNumber, uint32_t ackNumber) {
+  // the SYN offers the extended header, the SYN-ACK only
+  // answers with it if the SYN offered it
+  bool offer = (field & Packet::ACK) ? (extended != 0) : mainHandler->extendedHeaders;
+  if (!offer) {
+    return new Packet(packetPool, field, seqNumber, ackNumber);
+  }
+  uint8_t options[HANDSHAKEOPTIONSIZE];
+  uint16_t window = htons(inBufferSize >> windowScale);
+  memcpy(options, &window, sizeof(window));
+  options[2] = windowScale;
+  Packet *packet = new Packet(packetPool, field | Packet::EXT, seqNumber, ackNumber, options, sizeof(options));
+  packet->setHeaderLength(Packet::EXTHEADERSIZE + HANDSHAKEOPTIONSIZE);
+  return packet;
+}
+
+void UDPPlusConnection::readHandshake(Packet *handshake) {
+  uint32_t window = outBufferSize;
+  if (handshake->getField(Packet::EXT) && mainHandler->extendedHeaders) {
+    extended = Packet::EXT;
+    serial = SerialNumber(32);
+    uint8_t options[HANDSHAKEOPTIONSIZE];
+    if (handshake->getOptField(options, sizeof(options)) == sizeof(options)) {
+      uint16_t offered;
+      memcpy(&offered, options, sizeof(offered));
+      peerScale = (options[2] < MAXWINDOWSCALE) ? options[2] : MAXWINDOWSCALE;
+      window = (uint32_t) ntohs(offered) << peerScale;
+    }
+  }
+  else {
+    extended = 0;
+    serial = SerialNumber(16);
+  }
+  scoreboard.reset(serial);
+  outOfOrder.reset(serial);
+  uint32_t limit = serial.maxWindow();
+  if ((uint32_t) outBufferSize < limit) {
+    limit = outBufferSize;
+  }
+  maxInFlight = limit;
+  peerWindow = (window < limit) ? window : limit;
+  congestion->setMaxWindow(maxInFlight);
+}
+
+uint32_t UDPPlusConnection::nextSeq() {
+  uint32_t seqNumber = newSeqNum;
+  newSeqNum = serial.add(newSeqNum, 1);
+  return seqNumber;
+}
+
+void UDPPlusConnection::sampleRtt(time_duration rtt) {
+  counters.rtt.record(rtt);
+  if (!rttValid || rtt < minRtt) {
+    minRtt = rtt;
+  }
+  if (!rttValid) {
+    srtt = rtt;
+    rttvar = rtt / 2;
+    rttValid = true;
+  }
+  else {
+    time_duration delta = srtt - rtt;
+    if (delta.is_negative()) {
+      delta = delta.invert_sign();
     }
+    rttvar = (rttvar * 3 + delta) / 4;
+    srtt = (srtt * 7 + rtt) / 8;
+  }
+  rtoBackoff = 0;
+  updateRto();
+}
+
+void UDPPlusConnection::backoffRto() {
+  rtoBackoff++;
+  updateRto();
+}
+
+void UDPPlusConnection::updateRto() {
+  if (rttValid) {
+    time_duration variance = rttvar * 4;
+    // a lone packet's ack may be held back by the peer, and samples
+    // taken while the window is full never see that, as in QUIC's
+    // max_ack_delay
+    rto = srtt + (variance > CLOCKGRANULARITY ? variance : CLOCKGRANULARITY) + DELAYEDACK;
+  }
+  else {
+    rto = INITIALRTO;
+  }
+  if (rto < MINRTO) {
+    rto = MINRTO;
+  }
+  for (int i = 0; i < rtoBackoff && rto < MAXRTO; i++) {
+    rto = rto * 2;
+  }
+  if (rto > MAXRTO) {
+    rto = MAXRTO;
+  }
+}
+
+void UDPPlusConnection::wakeTimer() {
+  timerDeadline = microsec_clock::universal_time();
+  mainHandler->timers.wake(&timerEntry);
+}
+
+void UDPPlusConnection::armTimer(ptime when) {
+  if (when < timerDeadline) {
+    timerDeadline = when;
+    mainHandler->timers.schedule(&timerEntry, when);
   }
+}
 
-  cout << "exiting timer" << endl;
-  outCondition.notify_all();
-  inCondition.notify_all();
+void UDPPlusConnection::stopTimer() {
+  timerDone = true;
+  updateSubmitLimit();
+  wakeSenders();
+  wakeReader();
   closeCondition.notify_all();
 }
 
@@ -180,21 +750,38 @@ void UDPPlusConnection::send_packet(Packet * temp) {
   
   if (temp->sendCount > 10) {
     currentState = CLOSED;
-    timerCondition.notify_all();
-    inCondition.notify_all();
-    outCondition.notify_all();
+    wakeTimer();
+    wakeReader();
+    wakeSenders();
     closeCondition.notify_all();
     return;
   }
-  //cout << "Sending Data Packet" << endl;
   temp->setAckNumber(newAckNum, temp->getField(Packet::ACK));
+  if (temp->getField(Packet::DATA)) {
+    if (temp->sendCount > 0) {
+      counters.retransmits++;
+    }
+    else {
+      counters.packetsSent++;
+      counters.bytesSent += temp->getLength() - temp->getHeaderLength();
+    }
+  }
   temp->updateTime();
-  temp->numAck = 0;
   temp->sendCount++;
-  if (outItems == 0 && ackWaiting == 0) {
-    timerCondition.notify_one();
+  armTimer(temp->getTime() + rto);
+  output(temp);
+}
+
+void UDPPlusConnection::output(Packet *packet) {
+  // the ack rides along, nothing is left to acknowledge
+  if (packet->getField(Packet::ACK)) {
+    ackPending = 0;
   }
-  mainHandler->send_p(&remoteAddress, remoteAddressLength, temp);
+  if (packet->getField(Packet::EXT)) {
+    advertised = (receiveWindow() >> windowScale) << windowScale;
+    packet->setWindow(advertised >> windowScale);
+  }
+  mainHandler->send_p(&remoteAddress, remoteAddressLength, packet, shard);
 }
 
 const struct sockaddr* UDPPlusConnection::getSockAddr(socklen_t &addrLength) {
@@ -204,83 +791,117 @@ const struct sockaddr* UDPPlusConnection::getSockAddr(socklen_t &addrLength) {
 
 void UDPPlusConnection::handlePacket(Packet *currentPacket) {
   boost::mutex::scoped_lock l(sharedMutex);
-  //cout << "Recieved Packet" << endl;
+  // once the handshake is done every packet uses the negotiated header
+  if (currentState != LISTEN && currentState != SYN_SENT &&
+      currentPacket->getField(Packet::EXT) != (extended != 0)) {
+    delete currentPacket;
+    return;
+  }
+  UDPPLUS_TRACE("%p packet in state %d", (void *) this, currentState);
   switch(currentState) {
     case LISTEN:
     {
-      //cout << "in LISTEN" << endl;
       if (currentPacket->getField(Packet::SYN)) {
+        readHandshake(currentPacket);
         newAckNum = currentPacket->getSeqNumber();
         //srand(time(NULL));
         //newSeqNum = rand() % Packet::MAXSIZE;
         newSeqNum = 5;
-        Packet *current = new Packet(Packet::SYN | Packet::ACK, newSeqNum++, newAckNum++);
+        uint32_t ackNumber = newAckNum;
+        newAckNum = serial.add(newAckNum, 1);
+        lastAckRecv = newSeqNum;
+        Packet *current = handshakePacket(Packet::SYN | Packet::ACK, nextSeq(), ackNumber);
         send_packet(current);
         outBuffer[(outBufferBegin + outItems) % outBufferSize] = current;
         outItems++;
         //send packet
         currentState = ESTABLISHED;
-        //cout << "connection established" << endl;
-        outCondition.notify_all();
-        timerCondition.notify_one();
+        UDPPLUS_DEBUG("%p established", (void *) this);
+        wakeSenders();
+        wakeTimer();
       }
       break;
     }
     case SYN_SENT:
     {
-      //cout << "SYN_SENT" << endl;
       if (currentPacket->getField(Packet::SYN | Packet::ACK)) {
-        uint16_t ack_num = currentPacket->getAckNumber();
-        if (ack_num == newSeqNum) {
-          newAckNum = currentPacket->getSeqNumber() + 1;
+        // a peer without extended headers answers in 16 bits
+        SerialNumber replied(currentPacket->getField(Packet::EXT) ? 32 : 16);
+        uint32_t ack_num = currentPacket->getAckNumber();
+        if (ack_num == replied.wrap(newSeqNum)) {
+          readHandshake(currentPacket);
+          newSeqNum = serial.wrap(newSeqNum);
+          newAckNum = serial.add(currentPacket->getSeqNumber(), 1);
+          lastAckRecv = newSeqNum;
           
-          // sendAck();
-          Packet temp = Packet(Packet::ACK, lowestValidSeq(), newAckNum);
-          mainHandler->send_p(&remoteAddress, remoteAddressLength, &temp);
+          sendAck();
 
+          // Karn's rule, a resent SYN gives an ambiguous sample
+          if (outBuffer[outBufferBegin]->sendCount == 1) {
+            sampleRtt(microsec_clock::universal_time() - outBuffer[outBufferBegin]->getTime());
+          }
           delete outBuffer[outBufferBegin];
           outBuffer[outBufferBegin] = NULL;
           outBufferBegin = (outBufferBegin + 1) % outBufferSize;
           outItems--;
-          cout << "connection established";
+          UDPPLUS_DEBUG("%p established", (void *) this);
           currentState = ESTABLISHED;
-          outCondition.notify_all();
+          wakeSenders();
         }
       }
       delete currentPacket;
       break;
     }
-    case ESTABLISHED: cout << "IN ESTABLISHED" << endl;
-    case FIN_WAIT: cout << "IN FIN_WAIT" << endl;
-    case CLOSE_WAIT: cout << "IN CLOSE_WAIT" << endl;
+    case ESTABLISHED:
+    case FIN_WAIT:
+    case CLOSE_WAIT:
     {
       if (handleAck(currentPacket)) {
+        // so do submitted packets and a try_send message's fragments
+        if (submissions > 0) {
+          submitQueued();
+        }
+        if (!queuedMessage.empty()) {
+          pushFragments();
+        }
         if ( ! (handleData(currentPacket) || handleFin(currentPacket)) ) {
+          handleMtuProbe(currentPacket);
           delete currentPacket;
         }
       }
+      // both sides closed at once, ours is acked now
+      if (currentState == FIN_WAIT && finReceived && outItems == 0) {
+        currentState = TIME_WAIT;
+        UDPPLUS_DEBUG("%p in TIME_WAIT", (void *) this);
+        armTimer(microsec_clock::universal_time() + timeout);
+      }
       break;
       }
-    case LAST_ACK: cout << "IN LAST_ACK" << endl;
+    case LAST_ACK:
     {
       handleAck(currentPacket);
       if (outItems == 0) {
         currentState = CLOSED;
-        timerCondition.notify_all();
+        wakeTimer();
       }
       delete currentPacket;
       break;
     }
-    case TIME_WAIT: cout << "IN TIME_WAIT" << endl;
+    case TIME_WAIT:
       handleAck(currentPacket);
+      // the peer resends its FIN until our ack gets through
+      if (currentPacket->getField(Packet::FIN)) {
+        sendAck();
+      }
       delete currentPacket;
       break;
-    case CLOSED: cout << "IN CLOSED" << endl;
+    case CLOSED:
       delete currentPacket;
       break;
     default: delete currentPacket;
       break;
   }
+  updateSubmitLimit();
  //   if (currentPacket->getHeaderLength != currentPacket->getLength);
 }
 
@@ -289,138 +910,225 @@ bool UDPPlusConnection::handleAck(Packet *currentPacket) {
   if (!currentPacket->getField(Packet::ACK)) {
     return false;
   }
-  if (outItems == 0)
+  bool windowChanged = readWindow(currentPacket);
+  if (outItems == 0) {
+    if (windowChanged && !coalesced.empty()) {
+      flushDue();
+    }
     return true;
+  }
   
-  int tempAck = currentPacket->getAckNumber();
-  if (tempAck == newSeqNum) {
+  uint32_t tempAck = currentPacket->getAckNumber();
+  bool partialAck = false;
+  if (tempAck == newSeqNum || checkIfAckable(tempAck)) {
     lastAckRecv = tempAck;
-    releaseBufferTill(newSeqNum);
+    dupAcks = 0;
+    int acked = releaseBufferTill(tempAck);
+    scoreboard.advance(tempAck);
+    congestionAck(acked, tempAck);
+    // congestionAck ends recovery once recoverSeq is acked
+    partialAck = (acked > 0 && inRecovery);
+    if (!coalesced.empty()) {
+      flushDue();
+    }
   }
   else if (tempAck == lastAckRecv) {
-    //cerr << outBuffer[outBufferBegin] << endl;
-    //cerr << outItems << endl;
-    outBuffer[outBufferBegin]->numAck++;
-    if (outBuffer[outBufferBegin]->numAck >= 3) { // triplicateAck
-      outBuffer[outBufferBegin]->numAck++;
-      send_packet(outBuffer[outBufferBegin]);
+    // data, window updates and probes repeat the ack
+    // without saying anything was lost
+    if (!windowChanged && !currentPacket->getField(Packet::DATA) &&
+        currentPacket->getPayloadLength() == 0) {
+      if (++dupAcks == DUPTHRESH) {
+        counters.dupAckEvents++;
+      }
     }
-    handleSack(currentPacket);
   }
-  else if ( checkIfAckable(tempAck) ) {
-    lastAckRecv = tempAck;
-    numAck = 0;
-    releaseBufferTill(tempAck);
-    handleSack(currentPacket);
+  else {
+    return true;
   }
+  handleSack(currentPacket);
+  recoverLosses(partialAck);
   return true;
 }
 
 bool UDPPlusConnection::handleSack(Packet *currentPacket) {
-  if (!currentPacket->getField(Packet::OPT)) {
+  if (!currentPacket->getField(Packet::OPT) || outBuffer[outBufferBegin] == NULL) {
     return false;
   }
-  int length = (currentPacket->getHeaderLength() - Packet::DEFAULTHEADERSIZE);
-  uint8_t sackRanges[length];// = new uint16_t[optLength/4][2];
-    
-  currentPacket->getOptField(&sackRanges, sizeof(sackRanges));
-  int maxLength = 8 * length < (outItems - 1) ? 8 * length : (outItems - 1);
+  int length = (currentPacket->getHeaderLength() - currentPacket->getBaseHeaderLength());
+  uint8_t sackBlocks[length];
+  currentPacket->getOptField(&sackBlocks, sizeof(sackBlocks));
 
-  int counter = 0;
-  int index = (outBufferBegin + 1) & outBufferSize;
-  for(int i = 0; i < length; i++)
-  {
-    uint8_t current = 1;
-    for(int j = 0; j < 8; j++)
-    {
-      if (counter >= maxLength) { return true; }
-      if (outBuffer[index] == NULL) { return false; }
-      if ( (sackRanges[i] & current) != current )
-      {
-        if (outBuffer[index]->numAck == 3)
-          send_packet(outBuffer[index]);
-        else
-          outBuffer[index]->numAck++;
-        current = current << 1;
-      }
-      else { outBuffer[index]->numAck = -1; }
-      index = (index + 1) % outBufferSize;
-      counter++;
+  // only packets that were sent can be sacked
+  uint32_t first = outBuffer[outBufferBegin]->getSeqNumber();
+  uint32_t last = serial.add(first, outItems - unsent);
+  int width = extended ? 4 : 2;
+  for (int i = 0; i + 2 * width <= length; i += 2 * width) {
+    uint32_t start = readSequence(sackBlocks + i, width);
+    uint32_t end = readSequence(sackBlocks + i + width, width);
+    if (serial.lessThan(start, first)) {
+      start = first;
+    }
+    if (serial.lessThan(last, end)) {
+      end = last;
     }
+    scoreboard.add(start, end);
   }
   return true;  
 }
 
-void UDPPlusConnection::sendSack() {
-  if (inBufferDelta == 0) {
-    Packet temp = Packet(Packet::ACK, lowestValidSeq(), newAckNum);
-    mainHandler->send_p(&remoteAddress, remoteAddressLength, &temp);
+void UDPPlusConnection::recoverLosses(bool partialAck) {
+  Packet *head = outBuffer[outBufferBegin];
+  if (head == NULL || head->sendCount == 0) {
     return;
   }
-  
-  int size = (int) ceil((double) (inBufferDelta - 1) / 8);
-  uint8_t buf[size];
-  memset(&buf, 0, sizeof(buf));
-    
-  int counter = 1;
-  int index = (inBufferBegin + 1) % inBufferSize;
-  for(int i = 0; i < size; i++)
-  {
-    uint8_t current = 1;
-    for(int j = 0; j < 8; j++)
-    {
-      if (counter >= inBufferDelta) { break; }
-      if (inBuffer[index] == NULL) { }
-      else
-      {
-        buf[i] |= current;
-      }
-      current = current << 1;
-      index = (index + 1) % outBufferSize;
-      counter++;
+  uint32_t headSeq = head->getSeqNumber();
+  uint32_t lost = headSeq;
+  if (scoreboard.lossBoundary(DUPTHRESH, lost) && serial.lessThan(lost, headSeq)) {
+    lost = headSeq;
+  }
+  // without SACK blocks, three duplicate acks say the head was
+  // lost.  So does a partial ack, once the head has had a round
+  // trip and a quarter to arrive; sooner than that it is likely
+  // still in flight, or overtaken by what was sacked past it
+  bool headLost = dupAcks >= DUPTHRESH;
+  if (partialAck) {
+    time_duration due = rttValid ? srtt + srtt / 4 : rto;
+    headLost = headLost || head->getTime() + due < microsec_clock::universal_time();
+  }
+  if (headLost && serial.lessThan(lost, serial.add(headSeq, 1))) {
+    lost = serial.add(headSeq, 1);
+  }
+  if (serial.lessThan(highRxt, headSeq)) {
+    highRxt = headSeq;
+  }
+
+  int sent = outItems - unsent;
+  for (uint32_t seq = scoreboard.nextGap(highRxt); serial.lessThan(seq, lost);
+       seq = scoreboard.nextGap(highRxt)) {
+    int index = serial.diff(seq, headSeq);
+    if (index >= sent) {
+      break;
     }
+    congestionLoss();
+    counters.sackResends++;
+    send_packet(outBuffer[(outBufferBegin + index) % outBufferSize]);
+    highRxt = serial.add(seq, 1);
+  }
+
+  // after a timeout the rest of what was sent before it follows
+  // the head, as many at a time as the window has room for
+  if (!timedOut) {
+    return;
+  }
+  int window = sendWindow();
+  for (uint32_t seq = scoreboard.nextGap(highRxt);
+       serial.lessThan(seq, recoverSeq) && serial.diff(highRxt, headSeq) < window;
+       seq = scoreboard.nextGap(highRxt)) {
+    int index = serial.diff(seq, headSeq);
+    if (index >= sent) {
+      break;
+    }
+    send_packet(outBuffer[(outBufferBegin + index) % outBufferSize]);
+    highRxt = serial.add(seq, 1);
+  }
+}
+
+void UDPPlusConnection::sendAck() {
+  Packet temp = Packet(packetPool, Packet::ACK | extended, lowestValidSeq(), newAckNum);
+  output(&temp);
+}
+
+void UDPPlusConnection::ackReceived(int count, bool reordered, uint32_t latest) {
+  ackPending += count;
+  bool now = reordered || ackPending >= ackPolicy.packets || ackPolicy.delay <= time_duration(0, 0, 0);
+  if (reordered) {
+    quickAcksLeft = ackPolicy.quickAcks;
+  }
+  else if (quickAcksLeft > 0) {
+    quickAcksLeft--;
+    now = true;
+  }
+  if (now) {
+    // holes are reported at once, not held back
+    sendSack(latest);
+  }
+  else if (ackPending == count) {
+    ackTimestamp = microsec_clock::universal_time();
+    armTimer(ackTimestamp + ackPolicy.delay);
+  }
+}
+
+void UDPPlusConnection::sendSack(uint32_t latest) {
+  if (outOfOrder.empty()) {
+    sendAck();
+    return;
+  }
+  
+  uint32_t starts[MAXSACKBLOCKS];
+  uint32_t ends[MAXSACKBLOCKS];
+  int count = outOfOrder.blocks(latest, starts, ends, MAXSACKBLOCKS);
+  int width = extended ? 4 : 2;
+  uint8_t buf[count * 2 * width];
+  for (int i = 0; i < count; i++) {
+    writeSequence(starts[i], buf + 2 * width * i, width);
+    writeSequence(ends[i], buf + 2 * width * i + width, width);
   }
-  Packet temp = Packet(Packet::ACK | Packet::OPT, lowestValidSeq(), newAckNum, &buf, sizeof(buf));
-  mainHandler->send_p(&remoteAddress, remoteAddressLength, &temp);}
+  Packet temp = Packet(packetPool, Packet::ACK | Packet::OPT | extended, lowestValidSeq(), newAckNum, &buf, sizeof(buf));
+  output(&temp);
+}
 
 bool UDPPlusConnection::handleData(Packet *currentPacket) {
   if (!(currentPacket->getField(Packet::DATA) || currentPacket->getField(Packet::FIN))) {
     return false;
   }
   
-  int currentAckNumber = currentPacket->getSeqNumber();
-  uint16_t bottomAck = newAckNum;
-  
-  if (currentAckNumber < bottomAck) {
-    currentAckNumber += Packet::MAXSIZE;
-  }
+  uint32_t currentSeqNumber = currentPacket->getSeqNumber();
   if (currentState == CLOSE_WAIT) {
-    int tempMaxAckNumber = maxAckNumber;
-    if (currentAckNumber > maxAckNumber) { tempMaxAckNumber = maxAckNumber + Packet::MAXSIZE; }
-    
-    if ((tempMaxAckNumber - currentAckNumber) > inBufferDelta) {
+    if (serial.diff(maxAckNumber, currentSeqNumber) > inBufferDelta) {
       return false;
     }
   }
       
-  int index = currentAckNumber - bottomAck;
-  if (index < inBufferSize) {
-    index = (index + inBufferBegin) % inBufferSize;
-    inBufferDelta = (inBufferDelta > index) ? inBufferDelta : index;
-    if (inBuffer[index] != NULL) { delete inBuffer[index]; }
-    inBuffer[index] = currentPacket;
+  // distance past the next expected packet, negative for old data
+  int distance = serial.diff(currentSeqNumber, newAckNum);
+  // data past the advertised window is dropped, the window never
+  // covers more than delivered has room for.  classic headers carry
+  // no window, so a classic peer could only find out by losing
+  // packets and is left unbounded as before
+  int limit = (extended && currentPacket->getField(Packet::DATA)) ? receiveWindow() : inBufferSize;
+  if (distance >= 0 && distance < limit) {
+    int index = (distance + inBufferBegin) % inBufferSize;
+    // slots spanned from the next expected packet to the highest received
+    inBufferDelta = (inBufferDelta > distance + 1) ? inBufferDelta : distance + 1;
+    if (inBuffer[index] != NULL) {
+      counters.duplicates++;
+      delete inBuffer[index];
+    }
+    else if (currentPacket->getField(Packet::DATA)) {
+      counters.packetsReceived++;
+      counters.bytesReceived += currentPacket->getPayloadLength();
+    }
+    inBuffer[index] = currentPacket;
+    if (distance > 0) {
+      counters.reordered++;
+      outOfOrder.add(currentSeqNumber, serial.add(currentSeqNumber, 1));
+    }
     int count = processInBuffer();
     inBufferDelta -=count;
-    if (count != 1 || ackWaiting == 1) {
-      ackWaiting = 0;
-      sendSack();
-    } else {
-      ackWaiting = 1;
-    }
+    outOfOrder.advance(newAckNum);
+    ackReceived(count, count != 1 || distance != 0 || !outOfOrder.empty(), currentSeqNumber);
   }
   else {
-    Packet temp = Packet(Packet::ACK, lowestValidSeq(), newAckNum);
-    mainHandler->send_p(&remoteAddress, remoteAddressLength, &temp);
+    if (distance < 0) {
+      counters.duplicates++;
+    }
+    // data resent or outside the window means our acks are
+    // going missing, so ack at once for a while as after loss.
+    // empty window probes ask for nothing more than this ack
+    if (currentPacket->getPayloadLength() > 0) {
+      quickAcksLeft = ackPolicy.quickAcks;
+    }
+    sendAck();
     return false; }
   return true;
 }
@@ -434,17 +1142,14 @@ bool UDPPlusConnection::handleFin(Packet *currentPacket) {
     return false;
   }
   
-  int currentAckNumber = currentPacket->getSeqNumber();
-  if (currentAckNumber < newAckNum) {
-    currentAckNumber += Packet::MAXSIZE;
-  }
-  int index = currentAckNumber - newAckNum;
-  if (index < inBufferSize) {
+  uint32_t currentSeqNumber = currentPacket->getSeqNumber();
+  int index = serial.diff(currentSeqNumber, newAckNum);
+  if (index >= 0 && index < inBufferSize) {
 //    if( inBuffer[inBufferBegin + index] != NULL ) {
 //      delete inBuffer[inBufferBegin + index];
 //    }
-    maxAckNumber = (currentAckNumber + 1) % Packet::MAXSIZE;
-    if ( currentState == FIN_WAIT ) { currentState = TIME_WAIT; cout << "IN TIME_WAIT" << endl;}
+    maxAckNumber = serial.add(currentSeqNumber, 1);
+    if ( currentState == FIN_WAIT ) { currentState = TIME_WAIT; UDPPLUS_DEBUG("%p in TIME_WAIT", (void *) this); armTimer(microsec_clock::universal_time() + timeout); }
     else { currentState = CLOSE_WAIT; }
     return true;
   }
@@ -456,27 +1161,30 @@ int UDPPlusConnection::processInBuffer() {
   int currentPosition = inBufferBegin;
   while ( !done ) {
     if (inBuffer[currentPosition] != NULL) {
-      newAckNum = inBuffer[currentPosition]->getSeqNumber() + 1;
+      newAckNum = serial.add(inBuffer[currentPosition]->getSeqNumber(), 1);
       inBufferBegin = (inBufferBegin + 1) % inBufferSize;
       if (inBuffer[currentPosition]->getField(Packet::FIN)) {
-        if (outItems == 0) {
-          if ( currentState == FIN_WAIT ) { currentState = TIME_WAIT; cout << "IN TIME_WAIT" << endl;}
-          else { currentState = CLOSE_WAIT; }
-          inBuffer[currentPosition] = NULL;
-          delete inBuffer[currentPosition];
-          inCondition.notify_all();
+        // with our own FIN unacked, handlePacket enters TIME_WAIT
+        // once it is.  data of ours in flight is still resent
+        // and acked in CLOSE_WAIT
+        if ( currentState == FIN_WAIT ) {
+          finReceived = true;
+          if (outItems == 0) { currentState = TIME_WAIT; UDPPLUS_DEBUG("%p in TIME_WAIT", (void *) this); armTimer(microsec_clock::universal_time() + timeout); }
         }
+        else { currentState = CLOSE_WAIT; }
+        delete inBuffer[currentPosition];
+        inBuffer[currentPosition] = NULL;
+        wakeReader();
         done = true;
       }
       else if (inBuffer[currentPosition]->getField(Packet::DATA)) {
         count++;
-        inQueue.push_back(inBuffer[currentPosition]);
-        inCondition.notify_one();
+        deliver(inBuffer[currentPosition]);
         inBuffer[currentPosition] = NULL;
       }
       else { // in fin
-        inBuffer[currentPosition] = NULL;
         delete inBuffer[currentPosition];
+        inBuffer[currentPosition] = NULL;
 
       }
     }
@@ -488,108 +1196,936 @@ int UDPPlusConnection::processInBuffer() {
   return count;
 }
 
- int UDPPlusConnection::send(const void *buf, size_t len) {
-   //cout << "Sending Data" << endl;
-   boost::mutex::scoped_lock l(sharedMutex);
-
-   while (currentState == LISTEN || currentState == SYN_SENT || currentState == SYN_RECIEVED) {
-     outCondition.wait(l);
-   }
-   
-   switch (currentState) {
-     case ESTABLISHED:
-     case CLOSE_WAIT:   break;
-     case FIN_WAIT:
-     case LAST_ACK:
-     case TIME_WAIT:
-     case CLOSED:       return -1;
-     default: break;
-   }
-         
-  if (outItems == outBufferSize)
-    outCondition.wait(l);
-   
-   switch (currentState) {
-     case ESTABLISHED:
-     case CLOSE_WAIT:   break;
-     case FIN_WAIT:
-     case LAST_ACK:
-     case TIME_WAIT:
-     case CLOSED:       return -1;
-     default: break;
-   }
-  
-  Packet *currentPacket = new Packet(Packet::DATA | Packet::ACK, newSeqNum++, newAckNum , buf, len);
-  send_packet(currentPacket);
-  outBuffer[outBufferBegin + outItems % outBufferSize] = currentPacket;
-  outItems++;
+int UDPPlusConnection::send(const void *buf, size_t len) {
+  size_t limit = submitLimit;
+  if (limit > 0 && len <= limit) {
+    return submit(buf, len, true);
+  }
+  boost::mutex::scoped_lock l(sharedMutex);
+  return sendMessage(l, buf, len, true);
+}
+
+int UDPPlusConnection::try_send(const void *buf, size_t len) {
+  size_t limit = submitLimit;
+  if (limit > 0 && len <= limit) {
+    return submit(buf, len, false);
+  }
+  boost::mutex::scoped_lock l(sharedMutex);
+  return sendMessage(l, buf, len, false);
+}
+
+int UDPPlusConnection::submit(const void *buf, size_t len, bool block) {
+  boost::mutex::scoped_lock s(submitMutex);
+  // numbered once it is taken off submitted
+  Packet *currentPacket = new Packet(packetPool, Packet::DATA | Packet::ACK | submitHeader, 0, 0, buf, len);
+  while (!submitted.push(currentPacket)) {
+    boost::mutex::scoped_lock l(sharedMutex);
+    if (submitted.write_available() > 0) {
+      continue;
+    }
+    if (!(currentState == ESTABLISHED || currentState == CLOSE_WAIT)) {
+      delete currentPacket;
+      return wouldBlock(sendEvent, false);
+    }
+    if (!block) {
+      delete currentPacket;
+      return wouldBlock(sendEvent, true);
+    }
+    waitForSend(l);
+  }
+  // nobody else is transmitting submitted packets, an ack or
+  // whoever found the count above 0 does otherwise
+  if (submissions++ == 0) {
+    boost::mutex::scoped_lock l(sharedMutex);
+    submitQueued();
+  }
   return 0;
 }
 
-int UDPPlusConnection::recv(void *buf, size_t len) {
+bool UDPPlusConnection::submitQueued() {
+  bool taken = false;
+  while (submissions > 0) {
+    bool open = (currentState == ESTABLISHED || currentState == CLOSE_WAIT);
+    if (open && (outItems >= sendWindow() || sendingFragments)) {
+      break;
+    }
+    Packet *currentPacket = NULL;
+    submitted.pop(currentPacket);
+    submissions--;
+    taken = true;
+    if (!open) {
+      delete currentPacket;
+      continue;
+    }
+    currentPacket->setSeqNumber(nextSeq());
+    transmit(currentPacket);
+  }
+  if (taken) {
+    wakeSenders();
+  }
+  return submissions == 0;
+}
+
+void UDPPlusConnection::updateSubmitLimit() {
+  size_t limit = 0;
+  // coalesced messages and fragments keep to the locked path
+  if ((currentState == ESTABLISHED || currentState == CLOSE_WAIT) && coalesceMtu == 0 && !timerDone) {
+    limit = mtu - (extended ? Packet::EXTHEADERSIZE : Packet::DEFAULTHEADERSIZE);
+  }
+  if (limit != submitLimit) {
+    submitHeader = extended;
+    submitLimit = limit;
+  }
+}
+
+void UDPPlusConnection::waitForSend(boost::mutex::scoped_lock &l) {
+  sendersWaiting++;
+  outCondition.wait(l);
+  sendersWaiting--;
+}
+
+void UDPPlusConnection::wakeSenders() {
+  if (sendersWaiting > 0) {
+    outCondition.notify_all();
+  }
+  sendEvent.signal();
+}
+
+int UDPPlusConnection::sendMessage(boost::mutex::scoped_lock &l, const void *buf, size_t len, bool block) {
+  if (!block && !(currentState == ESTABLISHED || currentState == CLOSE_WAIT)) {
+    return wouldBlock(sendEvent, currentState == LISTEN || currentState == SYN_SENT || currentState == SYN_RECIEVED);
+  }
+  if (coalesceMtu > 0) {
+    // sized for the larger header, the mode may not be settled yet
+    size_t room = ((coalesceMtu < mtu) ? coalesceMtu : mtu) - Packet::EXTHEADERSIZE;
+    size_t framed = Packet::FRAMEHEADERSIZE + len;
+    if (coalesced.size() + framed > room && !coalesced.empty()) {
+      if (!block && !canSend()) {
+        return wouldBlock(sendEvent, true);
+      }
+      if (!flushCoalesced(l)) {
+        return -1;
+      }
+    }
+    // too big to share a packet, sent on its own below
+    if (framed <= room) {
+      uint16_t length = htons(len);
+      const char *frame = (const char *) &length;
+      coalesced.insert(coalesced.end(), frame, frame + sizeof(length));
+      coalesced.insert(coalesced.end(), (const char *) buf, (const char *) buf + len);
+      if (coalesced.size() == framed) {
+        coalesceDeadline = microsec_clock::universal_time() + coalesceDelay;
+        armTimer(coalesceDeadline);
+      }
+      // not even an empty message would fit, without
+      // waiting it goes once the window opens or the delay is up
+      if (coalesced.size() + Packet::FRAMEHEADERSIZE > room && (block || canSend()) && !flushCoalesced(l)) {
+        return -1;
+      }
+      return 0;
+    }
+  }
+  if (len + Packet::EXTHEADERSIZE > mtu) {
+    if (!block) {
+      return queueFragments((const char *) buf, len);
+    }
+    return sendFragments(l, (const char *) buf, len);
+  }
+  if (!block && !canSend()) {
+    return wouldBlock(sendEvent, true);
+  }
+  if (block && !waitToSend(l)) {
+    return -1;
+  }
+  Packet *currentPacket = new Packet(packetPool, Packet::DATA | Packet::ACK | extended, nextSeq(), newAckNum , buf, len);
+  transmit(currentPacket);
+  return 0;
+}
+
+int UDPPlusConnection::sendv(const struct iovec *iov, int iovcnt, boost::function<void()> onRelease) {
+  if (iovcnt < 0 || iovcnt > UDPPlus::MAXSEGMENTS) {
+    return -1;
+  }
   boost::mutex::scoped_lock l(sharedMutex);
-  if (currentState == CLOSE_WAIT || currentState == LAST_ACK || currentState == TIME_WAIT || currentState == CLOSED)
+  if (!coalesced.empty() && !flushCoalesced(l)) {
     return -1;
- 
-  if ( inQueue.empty() ) {
-    inCondition.wait(l);
   }
-  
-  if ( !inQueue.empty() ) {
-    Packet *currentPacket = inQueue.front();
-    inQueue.pop_front();
-    currentPacket->getData(buf, len);
-    delete currentPacket;
-    return 0;
+  size_t total = 0;
+  for (int i = 0; i < iovcnt; i++) {
+    total += iov[i].iov_len;
+  }
+  if (total + Packet::EXTHEADERSIZE > mtu) {
+    // fragments are built from a copy, the segments are free at once
+    vector<char> gathered;
+    gathered.reserve(total);
+    for (int i = 0; i < iovcnt; i++) {
+      gathered.insert(gathered.end(), (const char *) iov[i].iov_base,
+          (const char *) iov[i].iov_base + iov[i].iov_len);
+    }
+    int result = sendFragments(l, &gathered[0], total);
+    if (onRelease) {
+      onRelease();
+    }
+    return result;
+  }
+  if (!waitToSend(l)) {
+    return -1;
+  }
+  Packet *currentPacket = Packet::scatter(packetPool, Packet::DATA | Packet::ACK | extended, nextSeq(), newAckNum,
+      iov, iovcnt, onRelease);
+  transmit(currentPacket);
+  return 0;
+}
+
+bool UDPPlusConnection::waitToSend(boost::mutex::scoped_lock &l, bool continuing) {
+  while (currentState == LISTEN || currentState == SYN_SENT || currentState == SYN_RECIEVED) {
+    waitForSend(l);
+  }
+
+  // nothing may land between the fragments of a message, and
+  // submitted packets go first
+  while ((outItems >= sendWindow() || (!continuing && (sendingFragments || !submitQueued()))) &&
+      (currentState == ESTABLISHED || currentState == CLOSE_WAIT)) {
+    waitForSend(l);
+  }
+
+  switch (currentState) {
+    case ESTABLISHED:
+    case CLOSE_WAIT:   return true;
+    case FIN_WAIT:
+    case LAST_ACK:
+    case TIME_WAIT:
+    case CLOSED:       return false;
+    default: break;
+  }
+  return true;
+}
+
+int UDPPlusConnection::sendFragments(boost::mutex::scoped_lock &l, const char *buf, size_t len) {
+  if (len > MAXMESSAGESIZE) {
+    return -1;
+  }
+  if (!waitToSend(l)) {
+    return -1;
+  }
+  sendingFragments = true;
+  size_t offset = 0;
+  int result = 0;
+  while (offset < len) {
+    if (offset > 0 && !waitToSend(l, true)) {
+      result = -1;
+      break;
+    }
+    transmitFragment(buf, len, offset);
+  }
+  sendingFragments = false;
+  submitQueued();
+  // messages coalesced meanwhile may be overdue
+  if (!coalesced.empty()) {
+    flushDue();
+  }
+  wakeSenders();
+  return result;
+}
+
+void UDPPlusConnection::transmitFragment(const char *buf, size_t len, size_t &offset) {
+  size_t room = mtu - (extended ? Packet::EXTHEADERSIZE : Packet::DEFAULTHEADERSIZE);
+  Packet *currentPacket;
+  if (offset == 0) {
+    uint32_t total = htonl(len);
+    size_t part = (room - Packet::FRAGHEADERSIZE < len) ? room - Packet::FRAGHEADERSIZE : len;
+    currentPacket = new Packet(packetPool, Packet::DATA | Packet::ACK | Packet::FRAG | Packet::MSG | extended,
+        nextSeq(), newAckNum, &total, Packet::FRAGHEADERSIZE, buf, part);
+    offset = part;
+  }
+  else {
+    size_t part = (room < len - offset) ? room : len - offset;
+    currentPacket = new Packet(packetPool, Packet::DATA | Packet::ACK | Packet::FRAG | extended, nextSeq(), newAckNum,
+        buf + offset, part);
+    offset += part;
+  }
+  transmit(currentPacket);
+}
+
+int UDPPlusConnection::queueFragments(const char *buf, size_t len) {
+  if (len > MAXMESSAGESIZE) {
+    errno = EMSGSIZE;
+    return -1;
+  }
+  if (sendingFragments || !submitQueued()) {
+    return wouldBlock(sendEvent, true);
+  }
+  sendingFragments = true;
+  queuedMessage.assign(buf, buf + len);
+  queuedOffset = 0;
+  pushFragments();
+  return 0;
+}
+
+void UDPPlusConnection::pushFragments() {
+  bool open = (currentState == ESTABLISHED || currentState == CLOSE_WAIT);
+  while (open && queuedOffset < queuedMessage.size() && outItems < sendWindow()) {
+    transmitFragment(&queuedMessage[0], queuedMessage.size(), queuedOffset);
+  }
+  if (open && queuedOffset < queuedMessage.size()) {
+    return;
+  }
+  // sent, or the connection closed under it
+  vector<char>().swap(queuedMessage);
+  queuedOffset = 0;
+  sendingFragments = false;
+  submitQueued();
+  // messages coalesced meanwhile may be overdue
+  if (!coalesced.empty()) {
+    flushDue();
+  }
+  wakeSenders();
+}
+
+bool UDPPlusConnection::canSend() {
+  // submitted packets go first
+  return (currentState == ESTABLISHED || currentState == CLOSE_WAIT) &&
+      !sendingFragments && submitQueued() && outItems < sendWindow();
+}
+
+int UDPPlusConnection::wouldBlock(EventNotifier &event, bool open) {
+  if (!open) {
+    errno = ENOTCONN;
+    return -1;
   }
+  errno = EAGAIN;
+  event.reset();
   return -1;
 }
 
-void UDPPlusConnection::releaseBufferTill(int newSeqNum) {
-  uint16_t init = 0;
+int UDPPlusConnection::getRecvEventFd() {
+  boost::mutex::scoped_lock l(sharedMutex);
+  return recvEvent.descriptor();
+}
+
+int UDPPlusConnection::getSendEventFd() {
+  boost::mutex::scoped_lock l(sharedMutex);
+  return sendEvent.descriptor();
+}
+
+void UDPPlusConnection::setMtu(size_t mtu) {
+  boost::mutex::scoped_lock l(sharedMutex);
+  // a fragment carries the largest header, the length and some data
+  size_t smallest = Packet::EXTHEADERSIZE + Packet::FRAGHEADERSIZE + 1;
+  this->mtu = (mtu > smallest) ? mtu : smallest;
+  // the peer cannot receive anything longer
+  if (this->mtu > (size_t) UDPPlus::RECVBUFFERSIZE) {
+    this->mtu = UDPPlus::RECVBUFFERSIZE;
+  }
+  discovering = false;
+  mtuProbe = 0;
+  updateSubmitLimit();
+}
+
+void UDPPlusConnection::setMtuDiscovery(bool enabled) {
+  boost::mutex::scoped_lock l(sharedMutex);
+  if (enabled == discovering) {
+    return;
+  }
+  discovering = enabled;
+  mtuProbe = 0;
+  if (enabled) {
+    mtu = BASEMTU;
+    mtuCeiling = UDPPlus::RECVBUFFERSIZE;
+    mtuProbeTime = microsec_clock::universal_time();
+    wakeTimer();
+    updateSubmitLimit();
+  }
+}
+
+int UDPPlusConnection::recv(void *buf, size_t len) {
+  return receive(buf, len, true);
+}
+
+int UDPPlusConnection::recv(PayloadView &view) {
+  return receive(view, true);
+}
+
+int UDPPlusConnection::try_recv(void *buf, size_t len) {
+  return receive(buf, len, false);
+}
+
+int UDPPlusConnection::try_recv(PayloadView &view) {
+  return receive(view, false);
+}
+
+#ifdef UDPPLUS_COROUTINES
+Task<int> UDPPlusConnection::async_send(const void *buf, size_t len) {
+  int fd = getSendEventFd();
+  while (true) {
+    int result = try_send(buf, len);
+    if (result >= 0 || errno != EAGAIN || fd < 0) {
+      co_return result;
+    }
+    co_await Executor::readable(fd);
+  }
+}
+
+Task<int> UDPPlusConnection::async_recv(void *buf, size_t len) {
+  int fd = getRecvEventFd();
+  while (true) {
+    int result = try_recv(buf, len);
+    if (result >= 0 || errno != EAGAIN || fd < 0) {
+      co_return result;
+    }
+    co_await Executor::readable(fd);
+  }
+}
+
+Task<int> UDPPlusConnection::async_recv(PayloadView &view) {
+  int fd = getRecvEventFd();
+  while (true) {
+    int result = try_recv(view);
+    if (result >= 0 || errno != EAGAIN || fd < 0) {
+      co_return result;
+    }
+    co_await Executor::readable(fd);
+  }
+}
+#endif
+
+int UDPPlusConnection::receive(void *buf, size_t len, bool block) {
+  Packet *currentPacket = NULL;
+  boost::shared_ptr<Packet> shared;
+  char *message = NULL;
+  const char *data;
+  size_t length;
+  if (nextMessage(currentPacket, shared, message, data, length, block, (char *) buf, len) != success) {
+    return -1;
+  }
+  // fragments were copied into buf already
+  if (data != buf) {
+    memcpy(buf, data, (length < len) ? length : len);
+  }
+  if (currentPacket != NULL) {
+    delete currentPacket;
+  }
+  delete[] message;
+  // the rest of the message is gone, say so rather than
+  // hand back a message that looks complete
+  if (length > len) {
+    errno = EMSGSIZE;
+    return -1;
+  }
+  return 0;
+}
+
+int UDPPlusConnection::receive(PayloadView &view, bool block) {
+  view.release();
+  if (nextMessage(view.packet, view.shared, view.message, view.data, view.length, block) != success) {
+    view.release();
+    return -1;
+  }
+  return 0;
+}
+
+Error_code UDPPlusConnection::nextMessage(Packet *&packet, boost::shared_ptr<Packet> &shared, char *&message,
+    const char *&data, size_t &length, bool block, char *dest, size_t destLength) {
+  boost::mutex::scoped_lock reader(recvMutex);
+  while (true) {
+    // without waiting, fragments are gathered as they arrive
+    // so they never hold the receive window shut
+    if (gathering || (!block && !inFramed && peekPacket() != NULL && peekPacket()->getField(Packet::FRAG))) {
+      Error_code result = gatherFragments(block);
+      if (result == success) {
+        message = gathered;
+        gathered = NULL;
+        data = message;
+        length = gatheredTotal;
+        return success;
+      }
+      if (result == error) {
+        continue;
+      }
+      if (result == closed) {
+        errno = ENOTCONN;
+        return closed;
+      }
+      return underflow;
+    }
+    // nextPacket returns at once on a closing connection
+    if (!block && !inFramed && peekPacket() == NULL) {
+      Error_code result = nothingDelivered();
+      if (result == success) {
+        continue;
+      }
+      if (result == underflow) {
+        return underflow;
+      }
+    }
+    if (!inFramed) {
+      Packet *currentPacket = nextPacket();
+      if (currentPacket == NULL) {
+        errno = ENOTCONN;
+        return closed;
+      }
+      if (currentPacket->getField(Packet::FRAG)) {
+        Error_code result = assemble(currentPacket, message, data, length, dest, destLength);
+        if (result == closed) {
+          errno = ENOTCONN;
+          return closed;
+        }
+        if (result == success) {
+          return success;
+        }
+        continue;
+      }
+      if (!currentPacket->getField(Packet::MSG)) {
+        packet = currentPacket;
+        data = currentPacket->getPayload();
+        length = currentPacket->getPayloadLength();
+        return success;
+      }
+      inFramed.reset(currentPacket);
+      inOffset = 0;
+    }
+
+    const char *payload = inFramed->getPayload();
+    size_t total = inFramed->getPayloadLength();
+    uint16_t frame = 0;
+    if (inOffset + Packet::FRAMEHEADERSIZE <= total) {
+      memcpy(&frame, payload + inOffset, sizeof(frame));
+      frame = ntohs(frame);
+    }
+    if (inOffset + Packet::FRAMEHEADERSIZE + frame > total) {
+      // a frame that runs past the packet, drop the rest of it
+      inFramed.reset();
+      continue;
+    }
+    shared = inFramed;
+    data = payload + inOffset + Packet::FRAMEHEADERSIZE;
+    length = frame;
+    inOffset += Packet::FRAMEHEADERSIZE + frame;
+    if (inOffset + Packet::FRAMEHEADERSIZE > total) {
+      inFramed.reset();
+    }
+    return success;
+  }
+}
+
+Error_code UDPPlusConnection::gatherFragments(bool block) {
+  while (true) {
+    if (!block && peekPacket() == NULL) {
+      Error_code result = nothingDelivered();
+      if (result == success) {
+        continue;
+      }
+      if (result == underflow) {
+        return underflow;
+      }
+    }
+    Packet *fragment = nextPacket();
+    if (fragment != NULL && gathering &&
+        (!fragment->getField(Packet::FRAG) || fragment->getField(Packet::MSG))) {
+      // the next message began before this one was complete
+      returned = fragment;
+      fragment = NULL;
+    }
+    if (fragment == NULL) {
+      bool interrupted = (returned != NULL);
+      delete[] gathered;
+      gathered = NULL;
+      gathering = false;
+      return interrupted ? error : closed;
+    }
+    size_t skip = 0;
+    if (!gathering) {
+      gatheredTotal = 0;
+      if (fragment->getPayloadLength() >= Packet::FRAGHEADERSIZE) {
+        memcpy(&gatheredTotal, fragment->getPayload(), sizeof(gatheredTotal));
+        gatheredTotal = ntohl(gatheredTotal);
+      }
+      skip = (fragment->getPayloadLength() >= Packet::FRAGHEADERSIZE) ? Packet::FRAGHEADERSIZE : fragment->getPayloadLength();
+      // too big to hold, the fragments are read and dropped
+      gathered = (gatheredTotal <= MAXMESSAGESIZE) ? new char[gatheredTotal] : NULL;
+      gatheredLength = 0;
+      gathering = true;
+    }
+    size_t part = fragment->getPayloadLength() - skip;
+    if (gathered != NULL && gatheredLength < gatheredTotal) {
+      size_t copy = (part < gatheredTotal - gatheredLength) ? part : gatheredTotal - gatheredLength;
+      memcpy(gathered + gatheredLength, fragment->getPayload() + skip, copy);
+    }
+    gatheredLength += part;
+    delete fragment;
+    if (gatheredLength >= gatheredTotal) {
+      gathering = false;
+      if (gatheredLength != gatheredTotal || gathered == NULL) {
+        delete[] gathered;
+        gathered = NULL;
+        return error;
+      }
+      return success;
+    }
+  }
+}
+
+Error_code UDPPlusConnection::assemble(Packet *first, char *&message,
+    const char *&data, size_t &length, char *dest, size_t destLength) {
+  uint32_t total = 0;
+  if (first->getPayloadLength() >= Packet::FRAGHEADERSIZE) {
+    memcpy(&total, first->getPayload(), sizeof(total));
+    total = ntohl(total);
+  }
+  if (dest == NULL) {
+    // too big to hold, the fragments are read and dropped
+    message = (total <= MAXMESSAGESIZE) ? new char[total] : NULL;
+    dest = message;
+    destLength = (message != NULL) ? total : 0;
+  }
+
+  // each fragment is copied once, straight to its place in dest,
+  // and its packet freed before the next one is waited for
+  Packet *fragment = first;
+  size_t skip = (first->getPayloadLength() >= Packet::FRAGHEADERSIZE) ? Packet::FRAGHEADERSIZE : first->getPayloadLength();
+  size_t received = 0;
+  while (true) {
+    size_t part = fragment->getPayloadLength() - skip;
+    if (received < destLength) {
+      size_t copy = (part < destLength - received) ? part : destLength - received;
+      memcpy(dest + received, fragment->getPayload() + skip, copy);
+    }
+    received += part;
+    delete fragment;
+    if (received >= total) {
+      break;
+    }
+    fragment = nextPacket();
+    if (fragment == NULL || !fragment->getField(Packet::FRAG) || fragment->getField(Packet::MSG)) {
+      // closed, or the next message began before this one
+      // was complete, either way this one is lost
+      returned = fragment;
+      delete[] message;
+      message = NULL;
+      return (fragment == NULL) ? closed : error;
+    }
+    skip = 0;
+  }
+  if (received != total || dest == NULL) {
+    delete[] message;
+    message = NULL;
+    return error;
+  }
+  data = dest;
+  // the whole length, so a short dest can be told from a short message
+  length = total;
+  return success;
+}
+
+bool UDPPlusConnection::receiving() {
+  return !(currentState == CLOSE_WAIT || currentState == LAST_ACK || currentState == TIME_WAIT || currentState == CLOSED);
+}
+
+void UDPPlusConnection::deliver(Packet *packet) {
+  // the reader measures from here how long it waited
+  packet->updateTime();
+  // once anything overflows, the rest follows it until the reader
+  // has caught up, so packets stay in order
+  if (overflowed > 0 || !delivered.push(packet)) {
+    overflow.push_back(packet);
+    overflowed++;
+  }
+  wakeReader();
+}
+
+Packet* UDPPlusConnection::takePacket() {
+  Packet *currentPacket = returned;
+  if (currentPacket != NULL) {
+    returned = NULL;
+    return currentPacket;
+  }
+  if (!delivered.pop(currentPacket)) {
+    if (overflowed == 0) {
+      return NULL;
+    }
+    boost::mutex::scoped_lock l(sharedMutex);
+    if (!delivered.pop(currentPacket)) {
+      if (overflow.empty()) {
+        return NULL;
+      }
+      currentPacket = overflow.front();
+      overflow.pop_front();
+      overflowed--;
+    }
+  }
+  recvDelay.record(microsec_clock::universal_time() - currentPacket->getTime());
+  return currentPacket;
+}
+
+Packet* UDPPlusConnection::peekPacket() {
+  if (returned == NULL) {
+    returned = takePacket();
+  }
+  return returned;
+}
+
+Packet* UDPPlusConnection::nextPacket() {
+  while (true) {
+    Packet *currentPacket = takePacket();
+    if (currentPacket != NULL) {
+      reopenWindow();
+      return currentPacket;
+    }
+    boost::mutex::scoped_lock l(sharedMutex);
+    // deliver pushes with the lock held, so nothing slips in
+    // between this check and the wait
+    if (!delivered.empty() || !overflow.empty()) {
+      continue;
+    }
+    // data that arrived before the FIN is still handed out
+    if (!receiving()) {
+      return NULL;
+    }
+    readerSleeping = true;
+    inCondition.wait(l);
+    readerSleeping = false;
+  }
+}
+
+Error_code UDPPlusConnection::nothingDelivered() {
+  boost::mutex::scoped_lock l(sharedMutex);
+  if (!delivered.empty() || !overflow.empty()) {
+    return success;
+  }
+  if (!receiving()) {
+    return closed;
+  }
+  wouldBlock(recvEvent, true);
+  return underflow;
+}
+
+void UDPPlusConnection::reopenWindow() {
+  // reading reopened the window by half the buffer, tell a
+  // sender that may be held back by it
+  int threshold = (inBufferSize / 2 > 0) ? inBufferSize / 2 : 1;
+  if (!extended || inBufferSize - (int) (delivered.read_available() + overflowed) - advertised < threshold) {
+    return;
+  }
+  boost::mutex::scoped_lock l(sharedMutex);
+  if (receiveWindow() - advertised >= threshold) {
+    sendAck();
+  }
+}
+
+void UDPPlusConnection::wakeReader() {
+  if (readerSleeping) {
+    inCondition.notify_all();
+  }
+  recvEvent.signal();
+}
+
+void UDPPlusConnection::setCoalescing(size_t mtu, time_duration delay) {
+  boost::mutex::scoped_lock l(sharedMutex);
+  if (!coalesced.empty()) {
+    flushCoalesced(l);
+  }
+  // room for the largest header and at least one frame header
+  size_t smallest = Packet::EXTHEADERSIZE + Packet::FRAMEHEADERSIZE;
+  coalesceMtu = (mtu == 0 || mtu > smallest) ? mtu : smallest;
+  if (coalesceMtu > (size_t) Packet::MAXSIZE) {
+    coalesceMtu = Packet::MAXSIZE;
+  }
+  coalesceDelay = delay.is_negative() ? time_duration(0, 0, 0) : delay;
+  updateSubmitLimit();
+}
+
+int UDPPlusConnection::flush() {
+  boost::mutex::scoped_lock l(sharedMutex);
+  if (!coalesced.empty() && !flushCoalesced(l)) {
+    return -1;
+  }
+  return 0;
+}
+
+bool UDPPlusConnection::flushCoalesced(boost::mutex::scoped_lock &l) {
+  if (!waitToSend(l)) {
+    return false;
+  }
+  // the timer may have sent them while we waited
+  if (!coalesced.empty()) {
+    transmitCoalesced();
+  }
+  return true;
+}
+
+void UDPPlusConnection::flushDue() {
+  if (coalesceDeadline <= microsec_clock::universal_time() && !sendingFragments &&
+      (currentState == ESTABLISHED || currentState == CLOSE_WAIT) && submitQueued() && outItems < sendWindow()) {
+    transmitCoalesced();
+  }
+}
+
+void UDPPlusConnection::transmitCoalesced() {
+  Packet *currentPacket = new Packet(packetPool, Packet::DATA | Packet::ACK | Packet::MSG | extended,
+      nextSeq(), newAckNum, &coalesced[0], coalesced.size());
+  coalesced.clear();
+  transmit(currentPacket);
+}
+
+ConnectionStats::ConnectionStats() {
+  rttValid = false;
+  cwnd = ssthresh = 0;
+  mtu = 0;
+  packetsSent = bytesSent = retransmits = timeouts = dupAckEvents = sackResends = 0;
+  packetsReceived = bytesReceived = duplicates = reordered = 0;
+  inFlight = unsent = submitted = undelivered = outOfOrder = 0;
+}
+
+// one sample of a Prometheus series, counters and depths are
+// written whole, a double would round them to six digits
+static void writeSample(ostream &out, const char *name, const string &labels, uint64_t value) {
+  out << "udpplus_connection_" << name;
+  if (!labels.empty()) {
+    out << "{" << labels << "}";
+  }
+  out << " " << value << "\n";
+}
+
+// a sample in seconds
+static void writeSample(ostream &out, const char *name, const string &labels, time_duration value) {
+  out << "udpplus_connection_" << name;
+  if (!labels.empty()) {
+    out << "{" << labels << "}";
+  }
+  out << " " << value.total_microseconds() / 1e6 << "\n";
+}
+
+// a window in whole packets, ssthresh has no bound until the first loss
+static uint64_t wholePackets(double packets) {
+  return (packets < numeric_limits<int>::max()) ? (uint64_t) packets : numeric_limits<int>::max();
+}
+
+void ConnectionStats::writeJson(ostream &out) const {
+  out << "{\"srtt_us\":" << srtt.total_microseconds() << ",\"rttvar_us\":" << rttvar.total_microseconds()
+      << ",\"rto_us\":" << rto.total_microseconds() << ",\"rtt_valid\":" << (rttValid ? "true" : "false")
+      << ",\"cwnd\":" << cwnd << ",\"ssthresh\":" << ssthresh << ",\"mtu\":" << mtu
+      << ",\"packets_sent\":" << packetsSent << ",\"bytes_sent\":" << bytesSent
+      << ",\"retransmits\":" << retransmits << ",\"timeouts\":" << timeouts
+      << ",\"dup_ack_events\":" << dupAckEvents << ",\"sack_resends\":" << sackResends
+      << ",\"packets_received\":" << packetsReceived << ",\"bytes_received\":" << bytesReceived
+      << ",\"duplicates\":" << duplicates << ",\"reordered\":" << reordered
+      << ",\"in_flight\":" << inFlight << ",\"unsent\":" << unsent << ",\"submitted\":" << submitted
+      << ",\"undelivered\":" << undelivered << ",\"out_of_order\":" << outOfOrder << ",\"rtt\":";
+  rtt.writeJson(out);
+  out << ",\"recv_delay\":";
+  recvDelay.writeJson(out);
+  out << "}";
+}
+
+void ConnectionStats::writePrometheus(ostream &out, const string &labels) const {
+  writeSample(out, "srtt_seconds", labels, srtt);
+  writeSample(out, "rttvar_seconds", labels, rttvar);
+  writeSample(out, "rto_seconds", labels, rto);
+  writeSample(out, "cwnd_packets", labels, wholePackets(cwnd));
+  writeSample(out, "ssthresh_packets", labels, wholePackets(ssthresh));
+  writeSample(out, "mtu_bytes", labels, (uint64_t) mtu);
+  writeSample(out, "packets_sent_total", labels, packetsSent);
+  writeSample(out, "bytes_sent_total", labels, bytesSent);
+  writeSample(out, "retransmits_total", labels, retransmits);
+  writeSample(out, "timeouts_total", labels, timeouts);
+  writeSample(out, "dup_ack_events_total", labels, dupAckEvents);
+  writeSample(out, "sack_resends_total", labels, sackResends);
+  writeSample(out, "packets_received_total", labels, packetsReceived);
+  writeSample(out, "bytes_received_total", labels, bytesReceived);
+  writeSample(out, "duplicates_total", labels, duplicates);
+  writeSample(out, "reordered_total", labels, reordered);
+  writeSample(out, "in_flight_packets", labels, (uint64_t) inFlight);
+  writeSample(out, "unsent_packets", labels, (uint64_t) unsent);
+  writeSample(out, "submitted_packets", labels, (uint64_t) submitted);
+  writeSample(out, "undelivered_packets", labels, (uint64_t) undelivered);
+  writeSample(out, "out_of_order_packets", labels, (uint64_t) outOfOrder);
+  rtt.writePrometheus(out, "udpplus_connection_rtt_seconds", labels);
+  recvDelay.writePrometheus(out, "udpplus_connection_recv_delay_seconds", labels);
+}
+
+AckPolicy::AckPolicy() {
+  packets = DELAYEDACKPACKETS;
+  delay = DELAYEDACK;
+  quickAcks = QUICKACKS;
+}
+
+AckPolicy::AckPolicy(int packets, time_duration delay, int quickAcks) {
+  this->packets = packets;
+  this->delay = delay;
+  this->quickAcks = quickAcks;
+}
+
+PayloadView::PayloadView() {
+  message = NULL;
+  data = NULL;
+  length = 0;
+  packet = NULL;
+}
+
+PayloadView::~PayloadView() {
+  release();
+}
+
+void PayloadView::release() {
+  if (packet != NULL) {
+    delete packet;
+  }
+  shared.reset();
+  delete[] message;
+  message = NULL;
+  data = NULL;
+  length = 0;
+  packet = NULL;
+}
+
+int UDPPlusConnection::releaseBufferTill(uint32_t ackNumber) {
+  uint32_t init = 0;
   int total = 0;
   if (outBuffer[outBufferBegin] == NULL)
-    return;
+    return 0;
   
   init = outBuffer[outBufferBegin]->getSeqNumber();
-  
-  if(init <= newSeqNum) {
-    total = newSeqNum - (int)init;
-  } else {
-    total = ((int) Packet::MAXSIZE + (int) newSeqNum) - ((int)init);
+  total = serial.diff(ackNumber, init);
+  // never release packets that were not sent yet
+  if (total > outItems - unsent) {
+    total = outItems - unsent;
+  }
+  if (total < 0) {
+    total = 0;
   }
   int bufferLoc = outBufferBegin;
-  //cout << "outItems: " << outItems << endl;
-  //cout << "total Items: " << total << endl;
   
   for (int i = 0; i < total; i++) {
-    //cout << "Releasing Packet " << outBuffer[bufferLoc] << "from output" << endl;
+    // the newest packet covered by this ack gives the rtt sample
+    // Karn's rule, packets sent more than once are skipped
+    if (i == total - 1 && outBuffer[bufferLoc] != NULL && outBuffer[bufferLoc]->sendCount == 1) {
+      sampleRtt(microsec_clock::universal_time() - outBuffer[bufferLoc]->getTime());
+    }
     delete outBuffer[bufferLoc];
     outBufferBegin = (outBufferBegin + 1) % outBufferSize;
     outItems--;
     outBuffer[bufferLoc] = NULL;
     bufferLoc = (bufferLoc + 1) % outBufferSize;
   }
-  
+  if (total > 0) {
+    wakeSenders();
+  }
+  return total;
 }
 
-uint16_t UDPPlusConnection::lowestValidSeq() {
+uint32_t UDPPlusConnection::lowestValidSeq() {
   if (outBuffer[outBufferBegin] != NULL) {
     return outBuffer[outBufferBegin]->getSeqNumber();
   }
-  return newSeqNum - 1;
+  return serial.add(newSeqNum, -1);
 }
 
 
-bool UDPPlusConnection::checkIfAckable(const uint16_t &ackNumber) {
-  int currentAckNumber = ackNumber;
-  uint16_t tempAck = outBuffer[outBufferBegin]->getSeqNumber();
-  int bottomAck = tempAck;
-
-  if (currentAckNumber < bottomAck)
-    currentAckNumber += Packet::MAXSIZE;
-  
-  if (outItems < (currentAckNumber - bottomAck))
-    return true;
-  return false;
+bool UDPPlusConnection::checkIfAckable(const uint32_t &ackNumber) {
+  if (outBuffer[outBufferBegin] == NULL)
+    return false;
+  // an ack covers at least the oldest packet and at
+  // most every packet that has been sent
+  int distance = serial.diff(ackNumber, outBuffer[outBufferBegin]->getSeqNumber());
+  return distance > 0 && distance <= outItems - unsent;
 }
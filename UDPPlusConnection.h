@@ -16,6 +16,17 @@
 
 #include "utility.h"
 #include "Packet.h"
+#include "TimerWheel.h"
+#include "CongestionControl.h"
+#include "SerialNumber.h"
+#include "Scoreboard.h"
+#include "EventNotifier.h"
+#include "Histogram.h"
+#include "Task.h"
+
+#include <boost/shared_ptr.hpp>
+#include <boost/atomic.hpp>
+#include <boost/lockfree/spsc_queue.hpp>
 
 using namespace boost::posix_time;
 
@@ -25,17 +36,108 @@ enum State { LISTEN, SYN_SENT, SYN_RECIEVED, ESTABLISHED, FIN_WAIT, CLOSE_WAIT,
 
 class UDPPlus;
 
+// borrowed view of a received payload
+// data points into the packet the datagram was received into
+// and stays valid until release is called or the view is destroyed
+// that packet's buffer belongs to the packet pool of the UDPPlus
+// object the connection came from, so a view holding a payload
+// must be released before that UDPPlus is deleted.  it may
+// outlive the connection itself
+class PayloadView : private boost::noncopyable {
+public:
+  PayloadView();
+  ~PayloadView();
+
+  // hands the packet back to its pool
+  void release();
+
+  const char *data;
+  size_t length;
+
+private:
+  Packet *packet;
+  // a coalesced packet is shared by the views of its messages
+  boost::shared_ptr<Packet> shared;
+  // a fragmented message, reassembled into one buffer
+  char *message;
+
+  friend class UDPPlusConnection;
+};
+
+// snapshot of a connection's round trip estimates, counters
+// since it opened and queue depths
+struct ConnectionStats {
+  // estimates and depths unset, counters zero
+  ConnectionStats();
+
+  time_duration srtt;   // smoothed round trip time
+  time_duration rttvar; // round trip time variation
+  time_duration rto;    // current retransmission timeout, backoff included
+  bool rttValid;        // false until the first sample arrives
+  double cwnd;          // congestion window in packets
+  double ssthresh;      // slow start threshold in packets
+  size_t mtu;           // largest datagram sent, header included
+
+  uint64_t packetsSent;     // data packets, first transmissions only
+  uint64_t bytesSent;       // their payload
+  uint64_t retransmits;     // data packets sent again, for any reason
+  uint64_t timeouts;        // retransmission timeouts
+  uint64_t dupAckEvents;    // times duplicate acks reached the threshold
+  uint64_t sackResends;     // holes resent during loss recovery
+  uint64_t packetsReceived; // data packets accepted
+  uint64_t bytesReceived;   // their payload
+  uint64_t duplicates;      // data packets that had already arrived
+  uint64_t reordered;       // data packets that arrived past a hole
+
+  int inFlight;         // packets sent and not yet acked
+  int unsent;           // packets held back by pacing
+  int submitted;        // packets send queued for a sequence number
+  int undelivered;      // packets waiting for recv
+  int outOfOrder;       // packets held until a hole fills
+
+  Histogram rtt;        // round trip samples
+  Histogram recvDelay;  // time packets waited for recv
+
+  // one JSON object
+  void writeJson(ostream &out) const;
+  // Prometheus text format, udpplus_connection_ series without
+  // TYPE lines, so several connections can share one scrape
+  // labels are added to every series, without braces
+  void writePrometheus(ostream &out, const string &labels = "") const;
+};
+
+// when a connection acknowledges the data it receives
+// an ack waits for the first of packets unacknowledged packets
+// or delay, unless something lost or reordered needs reporting
+// any packet we send carries the ack along with it
+struct AckPolicy {
+  // every second packet, held back at most 5 ms, the first
+  // 8 acked at once
+  AckPolicy();
+  AckPolicy(int packets, time_duration delay, int quickAcks);
+
+  int packets;          // 1 acks every packet, more than a sender's
+                        // congestion window leaves it waiting on delay
+  time_duration delay;  // zero acks at once, a delay near the peer's
+                        // retransmission timeout causes resends
+  int quickAcks;        // packets acked at once after loss,
+                        // reordering or duplicate data, and when
+                        // the connection opens
+};
+
 class UDPPlusConnection {
 public:
 
   // initializes all data members
   // initializes buffer slots to NULL
-  // creates a timer boost thread
+  // registers with the UDPPlus timer wheel
+  // shard is the UDPPlus socket this connection sends and receives on
   UDPPlusConnection(UDPPlus *mainHandler,
       const struct sockaddr *remote,
       const socklen_t &remoteSize,
       int &bufferSize,
-      Packet *incomingConnection = 0);
+      Packet *incomingConnection = 0,
+      int shard = 0);
 
   // closes connection
   // deletes data structure and thread
@@ -47,23 +149,179 @@ public:
   
   // send function for client applications
   // wraps send_packet method and connection state
+  // with coalescing on, the message may wait to share a packet
+  // a message too big for one datagram is sent as fragments
 	int send(const void *, size_t);
+
+  // sends iov as one data packet without copying the payload
+  // messages waiting to be coalesced are flushed first
+  // too big for one datagram, it is copied and sent like send
+  // the header and the segments go out together through sendmsg
+  // the segments must stay valid until onRelease runs, which is
+  // once the packet has been acked or the connection is destroyed
+  // onRelease runs with the connection locked and must not call
+  // back into it
+  int sendv(const struct iovec *iov, int iovcnt,
+      boost::function<void()> onRelease = boost::function<void()>());
   
   // pops a data packet off the front of the inqueue
   // sets given buffer and length values to that of the packet
 	// when done, the packet is deleted
+  // a coalesced packet is returned one message per call
+  // a fragmented message is copied straight into buf
+  // a message longer than len fills buf and the rest is dropped,
+  // recv then returns -1 with errno set to EMSGSIZE
   int recv(void *buf, size_t len);
+
+  // pops a data packet off the front of the inqueue without copying
+  // view borrows the payload until it is released, which must
+  // happen before the UDPPlus object is deleted
+  // a view still holding a payload is released first
+  int recv(PayloadView &view);
+  
+  // non-blocking versions of send and recv, for one thread
+  // serving many connections through getRecvEventFd and
+  // getSendEventFd.  instead of waiting they return -1 with errno
+  // set to EAGAIN, or to ENOTCONN once the connection is closing
+  // a message too big for one datagram is taken whole and its
+  // fragments sent as acks open the window, later sends return
+  // EAGAIN until the last one is out
+  int try_send(const void *, size_t);
+  int try_recv(void *buf, size_t len);
+  int try_recv(PayloadView &view);
+
+  // descriptors for select, poll or epoll, readable once try_recv
+  // or try_send may succeed or the connection is closing.  each
+  // stays readable until its call returns EAGAIN, the application
+  // waits on them but never reads them
+  int getRecvEventFd();
+  int getSendEventFd();
+
+#ifdef UDPPLUS_COROUTINES
+  // coroutine versions of send and recv, for sessions run by an
+  // Executor.  where the blocking call would wait, the session is
+  // suspended until the connection's event descriptor is readable
+  // and the executor runs other sessions meanwhile
+  // results and errno are those of try_send and try_recv, except
+  // that EAGAIN is never returned
+  Task<int> async_send(const void *buf, size_t len);
+  Task<int> async_recv(void *buf, size_t len);
+  Task<int> async_recv(PayloadView &view);
+#endif
   
   // changes state to either FIN_WAIT or LAST_ACK
   // sends out a fin packet to close connection
 	void closeConnection();
+
+  // returns the current round trip and congestion estimates,
+  // counters and queue depths
+  ConnectionStats getStats();
+
+  // replaces the congestion control algorithm, NewReno by default
+  // the connection takes ownership of algorithm
+  void setCongestionControl(CongestionControl *algorithm);
+
+  // packs messages passed to send into shared packets of at most
+  // mtu bytes, header included, with a length before each one
+  // a packet goes out once it is full, delay after its first
+  // message, or on flush.  an mtu of 0 turns coalescing off
+  void setCoalescing(size_t mtu, time_duration delay = milliseconds(1));
+  // sends the messages waiting to be coalesced
+  int flush();
+
+  // largest datagram sent, UDP+ header included
+  // longer messages are split into fragments of this size
+  // fixes the size and turns path MTU discovery off, datagrams
+  // are sent with don't fragment set, so a size the path cannot
+  // carry is lost rather than fragmented
+  void setMtu(size_t mtu);
+  // searches for the largest datagram the path carries with
+  // padded probes, RFC 8899, starting from 1200 bytes, on by default
+  void setMtuDiscovery(bool enabled);
+
+  // replaces how received data is acknowledged
+  void setAckPolicy(const AckPolicy &policy);
+
+  // turns pacing of new packets on or off, on by default
+  // when off, send hands every packet to UDPPlus at once
+  void setPacing(bool enabled);
 	
 private:
-  // this method is threaded
+  // runs on the UDPPlus timer wheel
   // will detect timeouts
   // resends packet not yet acked, or sends an ack
+  // reschedules itself for the next deadline
   void timer();
 
+  // runs timer as soon as possible so it can pick up new deadlines
+  void wakeTimer();
+  // makes sure timer runs no later than when
+  void armTimer(ptime when);
+  // marks the timer finished and wakes everything waiting on the connection
+  void stopTimer();
+
+  // folds an rtt measurement into srtt and rttvar
+  // resets the backoff and recomputes rto
+  void sampleRtt(time_duration rtt);
+  // doubles rto after a retransmission timeout
+  void backoffRto();
+  // derives rto from srtt, rttvar and the backoff
+  void updateRto();
+
+  // feeds acked packets to the congestion control
+  // leaves fast recovery, or the resends after a timeout,
+  // once ackNumber passes recoverSeq
+  void congestionAck(int acked, uint32_t ackNumber);
+  // reports a fast retransmit, once per window of data
+  void congestionLoss();
+  // packets allowed in flight, the smallest of the congestion
+  // window, the out buffer and the peer's advertised window
+  int sendWindow();
+
+  // appends a new packet to the out buffer and sends it
+  // if its departure time has come, otherwise leaves it
+  // unsent for pace to release later
+  void transmit(Packet *packet);
+  // runs on the UDPPlus timer wheel
+  // sends the unsent packets whose departure time has come
+  void pace();
+  // returns true if the next packet must wait for nextDeparture
+  // otherwise claims the current departure slot
+  bool paceLater(ptime now);
+  // gap between packets, srtt spread over the congestion window
+  time_duration paceInterval();
+
+  // builds a SYN or SYN-ACK, offering the extended header
+  // and our receive window when extended headers are enabled
+  Packet* handshakePacket(uint8_t field, uint32_t seqNumber, uint32_t ackNumber);
+  // picks the header mode from the peer's SYN or SYN-ACK and
+  // limits packets in flight to the window it advertised
+  void readHandshake(Packet *handshake);
+  // returns newSeqNum and moves it forward
+  uint32_t nextSeq();
+
+  // packets the receive side can still take, inBufferSize
+  // less what the application has not read yet
+  int receiveWindow();
+  // takes the peer's advertised window from an extended header
+  // ignores acks older than lastAckRecv
+  // returns true if the window changed
+  bool readWindow(Packet *packet);
+  // probes a zero window with an empty DATA|ACK packet at
+  // newSeqNum - 1, which the peer drops as a duplicate and
+  // answers with an ack carrying its window
+  void sendProbe();
+
+  // sends, resends or gives up on the path MTU probe
+  // returns when it next needs to run
+  ptime searchMtu(ptime now);
+  // picks the next probe size between mtu and mtuCeiling
+  // or, once they meet, waits to search again
+  void nextMtuProbe(ptime now);
+  // answers a peer's probe with the length it arrived with
+  // or raises mtu when our probe is answered
+  void handleMtuProbe(Packet *currentPacket);
+
   // given a packet, redirects the data to
   // an appropriate destination based on the conneciton state
   // also establishes a connection
@@ -71,77 +329,275 @@ private:
   //void handleEstablished(Packet *currentPacket);
   
   // releases the packets from the inbuffer appropriately
-  // detects triple acks
+  // counts duplicate acks
   bool handleAck(Packet *currentPacket);
   // handles a sack packet
-  // detects the length and data in optional field
+  // marks the blocks in the optional field on the scoreboard
   bool handleSack(Packet *currentPacket);
+  // resends the holes the scoreboard or duplicate acks show
+  // were lost, each once per recovery, and after a timeout
+  // what was sent before it, as the window opens
+  // partialAck: the ack moved but stopped short of recoverSeq
+  void recoverLosses(bool partialAck);
   // sends an ack packet assuming there are
   // enough packets waiting to be acked
   bool handleData(Packet *currentPacket);
   // handles a fin packet
   // prepares the connection to be closed
   bool handleFin(Packet *currentPacket);
-  // sets the OPT flag to true
-  void sendSack();
+  // sends an ack without options
+  void sendAck();
+  // acks count newly delivered packets as the ack policy says
+  // reordered covers out of order arrivals, filled holes and
+  // duplicates, which are acked at once
+  void ackReceived(int count, bool reordered, uint32_t latest);
+  // sends an ack, with SACK blocks in the optional field
+  // if packets arrived out of order, the block holding
+  // latest first
+  void sendSack(uint32_t latest);
   
   // wrapper for UDPPlus send method
   // prepares a packet and sends it through
   void send_packet(Packet*);
+  // stamps our receive window on a packet and hands it to UDPPlus
+  // every packet this connection sends goes through here
+  void output(Packet*);
   
   // loop through inBuffer and check the sequence numbers
   // if sequence number is less than newSeqNum, delete from buffer
-  void releaseBufferTill(int newSeqNum);
+  // returns the number of packets released
+  int releaseBufferTill(uint32_t ackNumber);
   
   // returns next lowerst valid sequence number to be used
-  uint16_t lowestValidSeq();
+  uint32_t lowestValidSeq();
   
   // determines if a packet has been acked
   // if the packets sequence number is less than the given arg
   // return true, else false
-  bool checkIfAckable(const uint16_t &);
+  bool checkIfAckable(const uint32_t &);
   
+  // send and try_send, block says whether to wait for the window
+  int sendMessage(boost::mutex::scoped_lock &l, const void *buf, size_t len, bool block);
+  // recv and try_recv
+  int receive(void *buf, size_t len, bool block);
+  int receive(PayloadView &view, bool block);
+  // true if a new packet fits the window right now
+  bool canSend();
+  // sets errno to EAGAIN and resets event if the connection is
+  // open, otherwise to ENOTCONN, returns -1
+  int wouldBlock(EventNotifier &event, bool open);
+
+  // waits until the connection is established and the
+  // outgoing buffer has room
+  // unless continuing, also waits out another sender's fragments
+  // returns false if the connection closed while waiting
+  bool waitToSend(boost::mutex::scoped_lock &l, bool continuing = false);
+
+  // sends a message too big for one datagram as fragments
+  // with consecutive sequence numbers
+  int sendFragments(boost::mutex::scoped_lock &l, const char *buf, size_t len);
+  // builds and sends the fragment of buf starting at offset
+  // moves offset past it
+  void transmitFragment(const char *buf, size_t len, size_t &offset);
+  // copies a message for pushFragments to send without waiting
+  int queueFragments(const char *buf, size_t len);
+  // sends the queued message's fragments the window has room for
+  void pushFragments();
+
+  // false once the peer has closed, nothing more will arrive
+  bool receiving();
+
+  // hands a data packet to the reader
+  void deliver(Packet *packet);
+  // takes the next data packet without waiting, NULL if none
+  // has arrived.  the reader calls these with recvMutex held
+  Packet* takePacket();
+  // the packet takePacket returns next, left in place
+  Packet* peekPacket();
+  // waits for and takes the next data packet
+  // returns NULL once the connection is closing and nothing is left
+  Packet* nextPacket();
+  // called when a reader that may not wait found nothing
+  // returns success if something arrived meanwhile, closed if
+  // nothing will, otherwise underflow with recvEvent reset
+  Error_code nothingDelivered();
+  // tells the peer once reading has reopened half the window
+  void reopenWindow();
+  // wakes the reader if it waits and signals recvEvent
+  void wakeReader();
+
+  // puts a message that fits one datagram on submitted
+  // block says whether to wait for room there
+  int submit(const void *buf, size_t len, bool block);
+  // numbers and transmits the submitted packets the window has
+  // room for, drops them if the connection is closed
+  // returns true once none are left
+  bool submitQueued();
+  // republishes submitLimit after the state, mtu or coalescing changed
+  void updateSubmitLimit();
+  // waits on outCondition, counted in sendersWaiting
+  void waitForSend(boost::mutex::scoped_lock &l);
+  // wakes the threads waiting to send and signals sendEvent
+  void wakeSenders();
+
+  // waits for the next message, a whole packet, returned in packet
+  // for the caller to own, or one message of a coalesced packet,
+  // returned in shared
+  // returns closed once the connection is closing and nothing is
+  // left, underflow if block is false and nothing is ready
+  // a fragmented message is reassembled into dest, or into a new
+  // message buffer for the caller to own when dest is NULL
+  Error_code nextMessage(Packet *&packet, boost::shared_ptr<Packet> &shared, char *&message,
+      const char *&data, size_t &length, bool block, char *dest = NULL, size_t destLength = 0);
+  // reads fragments into gathered until the message is whole,
+  // returning success, or until nothing is left, returning
+  // underflow, if block is false.  returns error if the message
+  // was dropped, closed if the connection closed first
+  Error_code gatherFragments(bool block);
+  // reads the rest of the fragmented message that starts with first
+  // length is set to the whole message, even past destLength
+  // returns error if the fragments did not add up, closed if the
+  // connection closed before the message was complete
+  Error_code assemble(Packet *first, char *&message,
+      const char *&data, size_t &length, char *dest, size_t destLength);
+
+  // waits for room in the window, then sends the coalesced messages
+  // returns false if the connection closed while waiting
+  bool flushCoalesced(boost::mutex::scoped_lock &l);
+  // sends the coalesced messages if their delay is up and the
+  // window has room, from the timer and as acks open the window
+  void flushDue();
+  // sends the coalesced messages as one packet, the caller
+  // has checked the window
+  void transmitCoalesced();
+
   // counts how many packets are awaiting to be acked
   // also deletes the packets out of the inbuffer
   int processInBuffer();
 
   UDPPlus *mainHandler; // belongs to a UDPPlus object
                         // stores ptr to object to call UDPPlus methods
+  PacketPool *packetPool; // mainHandler's pool, used for every packet built here
   State currentState; // current connection state
+  bool finReceived;   // the peer's FIN came before ours was acked
   
-  boost::thread *clock;
+  TimerWheel::Entry timerEntry;
+  ptime timerDeadline;  // when timerEntry is next due
+  bool timerDone;       // set once the connection is CLOSED for good
+  ptime idleSince;      // last time the timer found work pending
 	time_duration timeout;
   time_duration maximumTimeout;
-  ptime ackTimestamp;
-  uint8_t ackWaiting; // 
-  uint8_t numAck;
+  time_duration srtt;
+  time_duration rttvar;
+  time_duration minRtt; // lowest round trip sampled
+  time_duration rto;    // retransmission timeout, replaces timeout for resends
+  bool rttValid;
+  int rtoBackoff;       // consecutive retransmission timeouts
+
+  CongestionControl *congestion;
+  bool inRecovery;      // a loss was reported and not yet repaired
+  bool timedOut;        // resending from the head after a timeout
+  ptime timedOutAt;     // when the head was resent for it
+  uint32_t recoverSeq;  // newSeqNum when the loss or timeout happened
+  Scoreboard scoreboard; // packets in flight the peer has sacked
+  uint32_t highRxt;     // holes before this were resent in this recovery
+  int dupAcks;          // acks in a row that did not move lastAckRecv
+
+  TimerWheel::Entry paceEntry;
+  bool pacing;
+  ptime nextDeparture;  // earliest time the next new packet may leave
+  int unsent;           // packets at the end of outBuffer not sent yet
+
+  SerialNumber serial;  // 16 or 32 bit sequence space
+  uint8_t extended;     // Packet::EXT once negotiated, otherwise 0
+  int maxInFlight;      // smaller of outBufferSize and half the sequence space
+  int windowScale;      // our advertised window is shifted right by this
+  int peerScale;        // and the peer's shifted left by this
+  int peerWindow;       // packets the peer last said it could take
+  boost::atomic<int> advertised; // receive window last sent to the peer
+
+  size_t coalesceMtu;   // 0 when coalescing is off
+  time_duration coalesceDelay;
+  ptime coalesceDeadline; // when the waiting messages must go out
+  vector<char> coalesced; // framed messages waiting for a packet
+  boost::shared_ptr<Packet> inFramed; // coalesced packet being read
+  size_t inOffset;      // next frame in inFramed
+  size_t mtu;           // largest datagram the path is known to carry
+  bool discovering;     // path MTU discovery is on
+  size_t mtuCeiling;    // largest size not yet found too big
+  size_t mtuProbe;      // size of the probe in flight, 0 when none
+  int mtuProbes;        // times it has been sent
+  ptime mtuProbeTime;   // when the probe is lost, or the next is due
+  bool sendingFragments; // a message's fragments are going out
+  vector<char> queuedMessage; // a try_send message being fragmented
+  size_t queuedOffset;  // next byte of it to send
+  bool gathering;       // a fragmented message is part way read
+  char *gathered;       // into here, NULL if it is being dropped
+  uint32_t gatheredTotal; // its length
+  size_t gatheredLength; // and how much of it has arrived
+  ptime probeTime;      // next zero window probe
+  int probeBackoff;
+  AckPolicy ackPolicy;
+  ptime ackTimestamp;   // when the oldest unacknowledged packet arrived
+  int ackPending;       // packets received and not acknowledged yet
+  int quickAcksLeft;    // packets still to be acked at once
+  // counters for getStats, guarded by sharedMutex
+  ConnectionStats counters;
+  Histogram recvDelay;  // recorded by the reader without sharedMutex
 
-  boost::condition_variable timerCondition;
   boost::condition_variable inCondition;
   boost::condition_variable outCondition;
   boost::condition_variable closeCondition;
   boost::mutex sharedMutex;
+  EventNotifier recvEvent; // signalled alongside inCondition
+  EventNotifier sendEvent; // and outCondition
+
+  // data packets in order, pushed with sharedMutex held and
+  // popped by the reader without it
+  boost::lockfree::spsc_queue<Packet*> delivered;
+  // what a classic peer sends past delivered's room, it carries
+  // no window to hold the peer back.  guarded by sharedMutex
+  deque<Packet*> overflow;
+  boost::atomic<int> overflowed; // overflow.size(), read without the lock
+  Packet *returned;     // a packet the reader took and put back
+  // one reader at a time, guards the reader's state, inFramed,
+  // gathered and returned.  taken before sharedMutex
+  boost::mutex recvMutex;
+  bool readerSleeping;  // the reader waits on inCondition
 
-  deque< Packet* > inQueue;
+  // packets built by send and try_send, numbered and transmitted
+  // by whoever holds sharedMutex once the window has room
+  boost::lockfree::spsc_queue<Packet*> submitted;
+  // packets pushed on submitted and not taken yet, the sender that
+  // counts up from 0 transmits them itself
+  boost::atomic<int> submissions;
+  // one sender at a time on submitted, taken before sharedMutex
+  boost::mutex submitMutex;
+  // largest payload send may put on submitted, 0 while it may not
+  boost::atomic<size_t> submitLimit;
+  boost::atomic<uint8_t> submitHeader; // flags of the packets it builds
+  int sendersWaiting;   // threads waiting on outCondition
   Packet **inBuffer; // for array of pointers
   Packet **outBuffer;
   int inBufferSize; // changed from unsigned
   int outBufferSize;
-  uint16_t inBufferBegin; // Current position 
-  uint16_t outBufferBegin;
+  int inBufferBegin; // Current position 
+  int outBufferBegin;
   //uint16_t inItems;       // Number of items
-  uint16_t outItems;      // Number of Items in the outgoing buffer
-  int8_t inBufferDelta;   // This is used to determine the difference between
+  int outItems;      // Number of Items in the outgoing buffer
+  int inBufferDelta;      // This is used to determine the difference between
                           // the last acked segment recieved and the highest segment
                           // recieved that hasn't been acked yet (out of order packets)
+  Scoreboard outOfOrder;  // packets received past newAckNum
   
-  uint16_t newAckNum;     // The Remote Sequence number that can be confirmed recieved.
-  uint16_t newSeqNum;     // New Sequence number that will be sent out
-  uint16_t lastAckRecv;
-  int maxAckNumber;
+  uint32_t newAckNum;     // The Remote Sequence number that can be confirmed recieved.
+  uint32_t newSeqNum;     // New Sequence number that will be sent out
+  uint32_t lastAckRecv;
+  uint32_t maxAckNumber;
 
 	struct sockaddr remoteAddress;
 	socklen_t remoteAddressLength;
+	int shard;
 
 	friend class UDPPlus;
 };
@@ -0,0 +1,146 @@
+/*
+ * bench_batch.cpp
+ *
+ *  Created on: Oct 16, 2026
+ *
+ *  Measures packets per second over loopback when datagrams
+ *  are sent with sendmmsg() and received with recvmmsg() in
+ *  batches of 1 through 64.  Every datagram is the size of a
+ *  small UDP+ data packet.
+ *
+ *  Then measures the same through a UDP+ connection whose
+ *  UDPPlus objects batch their sends and receives, so the
+ *  protocol's own packets and acks take the batched path.
+ */
+
+#include "utility.h"
+#include "DatagramBatch.h"
+#include "UDPPlus.h"
+#include "UDPPlusConnection.h"
+
+using namespace boost::posix_time;
+
+const int PAYLOAD = 20;
+const int RUNMILLISECONDS = 500;
+const int PORT = 9710;
+
+volatile bool running;
+volatile long received;
+
+void receiver(int sockfd, int batchSize) {
+  DatagramBatch batch(batchSize, 2048);
+  while (running) {
+    int count = batch.receive(sockfd);
+    if (count <= 0) {
+      break;
+    }
+    received = received + count;
+  }
+}
+
+void connectionReceiver(UDPPlusConnection *connection, long *messages) {
+  PayloadView view;
+  while (connection->recv(view) == 0) {
+    (*messages)++;
+  }
+  view.release();
+  connection->closeConnection();
+}
+
+// messages a UDP+ connection delivers per second
+long connectionRate(int batchSize, int port) {
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+
+  UDPPlus *server = new UDPPlus(1, 1024);
+  server->setBatching(batchSize);
+  server->bind_p((struct sockaddr *) &address, sizeof(address));
+  UDPPlus *client = new UDPPlus(1, 1024);
+  client->setBatching(batchSize);
+  UDPPlusConnection *outgoing = client->conn((struct sockaddr *) &address, sizeof(address));
+  UDPPlusConnection *incoming = server->accept_p();
+
+  long messages = 0;
+  boost::thread listener(boost::bind(&connectionReceiver, incoming, &messages));
+  char payload[PAYLOAD];
+  memset(payload, 'x', sizeof(payload));
+  ptime start = microsec_clock::universal_time();
+  ptime end = start + milliseconds(RUNMILLISECONDS);
+  while (microsec_clock::universal_time() < end) {
+    if (outgoing->send(payload, sizeof(payload)) < 0) {
+      break;
+    }
+  }
+  outgoing->closeConnection();
+  listener.join();
+  double seconds = (microsec_clock::universal_time() - start).total_microseconds() / 1000000.0;
+
+  delete outgoing;
+  delete incoming;
+  delete client;
+  delete server;
+  return (long) (messages / seconds);
+}
+
+int main(int argc, char* argv[]) {
+  int batchSizes[] = { 1, 2, 4, 8, 16, 32, 64 };
+
+  cout << "batch\tsent pkt/s\treceived pkt/s" << endl;
+  for (size_t b = 0; b < sizeof(batchSizes) / sizeof(batchSizes[0]); b++) {
+    int batchSize = batchSizes[b];
+
+    struct sockaddr_in local;
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_port = 0;
+    inet_pton(AF_INET, "127.0.0.1", &local.sin_addr);
+
+    int in = socket(AF_INET, SOCK_DGRAM, 0);
+    int out = socket(AF_INET, SOCK_DGRAM, 0);
+    int bufferBytes = 8 * 1024 * 1024;
+    setsockopt(in, SOL_SOCKET, SO_RCVBUF, &bufferBytes, sizeof(bufferBytes));
+    if (bind(in, (struct sockaddr *) &local, sizeof(local)) < 0) {
+      printf("error binding socket");
+      exit(1);
+    }
+    socklen_t localLength = sizeof(local);
+    getsockname(in, (struct sockaddr *) &local, &localLength);
+
+    running = true;
+    received = 0;
+    boost::thread listener(boost::bind(&receiver, in, batchSize));
+
+    char payload[PAYLOAD];
+    memset(payload, 'x', sizeof(payload));
+    DatagramBatch batch(batchSize, sizeof(payload));
+    long sent = 0;
+    ptime start = microsec_clock::universal_time();
+    ptime end = start + milliseconds(RUNMILLISECONDS);
+    while (microsec_clock::universal_time() < end) {
+      for (int i = 0; i < 64; i += batchSize) {
+        while (batch.add((struct sockaddr *) &local, sizeof(local), payload, sizeof(payload))) { }
+        sent += batch.flush(out);
+      }
+    }
+    double seconds = (microsec_clock::universal_time() - start).total_microseconds() / 1000000.0;
+    long receivedCount = received;
+
+    running = false;
+    shutdown(in, SHUT_RDWR);
+    listener.join();
+    close(in);
+    close(out);
+
+    cout << batchSize << "\t" << (long) (sent / seconds) << "\t\t" << (long) (receivedCount / seconds) << endl;
+  }
+
+  cout << endl << "batch\tUDP+ messages/s" << endl;
+  for (size_t b = 0; b < sizeof(batchSizes) / sizeof(batchSizes[0]); b++) {
+    // a fresh port each run, the last one's may still be draining
+    cout << batchSizes[b] << "\t" << connectionRate(batchSizes[b], PORT + b) << endl;
+  }
+  return 0;
+}
@@ -0,0 +1,89 @@
+/*
+ * bench_demux.cpp
+ *
+ *  Created on: Oct 16, 2026
+ *
+ *  Measures the cost of routing an incoming datagram to its
+ *  connection as the number of connections grows.  The old
+ *  linear scan over connectionList is compared against the
+ *  ConnectionDemux hash lookup.
+ */
+
+#include "utility.h"
+#include "ConnectionDemux.h"
+
+using namespace boost::posix_time;
+
+// keeps the compiler from discarding the lookups
+volatile long sink;
+
+// builds count distinct peers spread over addresses and ports
+void buildPeers(vector<struct sockaddr_in> &peers, int count) {
+  peers.resize(count);
+  for (int i = 0; i < count; i++) {
+    memset(&peers[i], 0, sizeof(peers[i]));
+    peers[i].sin_family = AF_INET;
+    peers[i].sin_port = htons(1024 + (i % 60000));
+    peers[i].sin_addr.s_addr = htonl(0x0A000000 + (i / 60000));
+  }
+}
+
+// the loop UDPPlus::isHostConnected used before the demux table
+int linearScan(const vector<struct sockaddr_in> &peers, const struct sockaddr_in *temp) {
+  for (size_t i = 0; i < peers.size(); i++) {
+    if ( (temp->sin_port == peers[i].sin_port) &&
+         (temp->sin_addr.s_addr == peers[i].sin_addr.s_addr) &&
+         (temp->sin_family == peers[i].sin_family) )
+    {
+      return (int) i;
+    }
+  }
+  return -1;
+}
+
+int main(int argc, char* argv[]) {
+  const int LOOKUPS = 200000;
+  int counts[] = { 16, 64, 256, 1024, 4096, 16384, 65536 };
+
+  cout << "connections\tlinear ns/lookup\tdemux ns/lookup" << endl;
+  for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+    int count = counts[c];
+    vector<struct sockaddr_in> peers;
+    buildPeers(peers, count);
+
+    ConnectionDemux demux(count);
+    for (int i = 0; i < count; i++) {
+      demux.insert((struct sockaddr *) &peers[i], sizeof(peers[i]), i);
+    }
+
+    // visit peers in a scattered order so neither method
+    // benefits from always hitting the front of the table
+    vector<int> order(LOOKUPS);
+    srand(count);
+    for (int i = 0; i < LOOKUPS; i++) {
+      order[i] = rand() % count;
+    }
+
+    // the linear scan is far too slow at large counts to run
+    // every lookup, so it is sampled with fewer iterations
+    int linearLookups = LOOKUPS / (count / 16 > 0 ? count / 16 : 1);
+    if (linearLookups < 100) linearLookups = 100;
+
+    long checksum = 0;
+    ptime start = microsec_clock::universal_time();
+    for (int i = 0; i < linearLookups; i++) {
+      checksum += linearScan(peers, &peers[order[i]]);
+    }
+    double linearNs = (microsec_clock::universal_time() - start).total_microseconds() * 1000.0 / linearLookups;
+
+    start = microsec_clock::universal_time();
+    for (int i = 0; i < LOOKUPS; i++) {
+      checksum += demux.find((struct sockaddr *) &peers[order[i]], sizeof(peers[0]));
+    }
+    double demuxNs = (microsec_clock::universal_time() - start).total_microseconds() * 1000.0 / LOOKUPS;
+
+    sink = checksum;
+    cout << count << "\t\t" << linearNs << "\t\t\t" << demuxNs << endl;
+  }
+  return 0;
+}
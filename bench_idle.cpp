@@ -0,0 +1,135 @@
+/*
+ * bench_idle.cpp
+ *
+ *  Created on: Oct 16, 2026
+ *
+ *  Opens up to 10,000 idle connections to one UDPPlus server
+ *  on loopback and reports the server process's memory, thread
+ *  count and CPU use while they sit idle.  Clients are plain
+ *  sockets that complete the handshake by hand and then go
+ *  away, so everything measured belongs to the server side.
+ */
+
+#include "utility.h"
+#include "UDPPlus.h"
+#include "UDPPlusConnection.h"
+
+#include <sys/resource.h>
+
+using namespace boost::posix_time;
+
+const int PORT = 9655;
+const int IDLESECONDS = 5;
+
+// reads a field such as VmRSS or Threads from /proc/self/status
+long readStatus(const string &field) {
+  ifstream status("/proc/self/status");
+  string line;
+  while (getline(status, line)) {
+    if (line.compare(0, field.size(), field) == 0) {
+      return atol(line.c_str() + field.size() + 1);
+    }
+  }
+  return -1;
+}
+
+double cpuSeconds() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+      (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000000.0;
+}
+
+void acceptor(UDPPlus *server, int count, vector<UDPPlusConnection*> *accepted) {
+  for (int i = 0; i < count; i++) {
+    UDPPlusConnection *connection = server->accept_p();
+    if (connection == NULL) {
+      return;
+    }
+    accepted->push_back(connection);
+  }
+}
+
+// runs the SYN, SYN-ACK, ACK exchange from client number i
+bool handshake(int i, const struct sockaddr_in &server) {
+  int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+  struct sockaddr_in local;
+  memset(&local, 0, sizeof(local));
+  local.sin_family = AF_INET;
+  local.sin_port = htons(20000 + i % 40000);
+  local.sin_addr.s_addr = htonl(0x7F000002 + i / 40000);
+  if (bind(sockfd, (struct sockaddr *) &local, sizeof(local)) < 0) {
+    close(sockfd);
+    return false;
+  }
+  // a SYN that arrives while the acceptor is between accept_p
+  // calls is dropped, so retry quickly
+  struct timeval wait = { 0, 2000 };
+  setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &wait, sizeof(wait));
+
+  uint16_t seq = 100;
+  bool established = false;
+  for (int attempt = 0; attempt < 100 && !established; attempt++) {
+    Packet syn(Packet::SYN, seq, 0);
+    sendto(sockfd, syn.getBuffer(), syn.getLength(), 0, (struct sockaddr *) &server, sizeof(server));
+    char buffer[64];
+    int length = recv(sockfd, buffer, sizeof(buffer), 0);
+    if (length < (int) Packet::DEFAULTHEADERSIZE) {
+      continue;
+    }
+    Packet synAck(buffer, length);
+    if (synAck.getField(Packet::SYN | Packet::ACK)) {
+      Packet ack(Packet::ACK, seq + 1, synAck.getSeqNumber() + 1);
+      sendto(sockfd, ack.getBuffer(), ack.getLength(), 0, (struct sockaddr *) &server, sizeof(server));
+      established = true;
+    }
+  }
+  close(sockfd);
+  return established;
+}
+
+int main(int argc, char* argv[]) {
+  int steps[] = { 1000, 2500, 5000, 10000 };
+  const int MAXCONNECTIONS = 10000;
+
+  // a small window keeps per-connection buffers from dominating
+  UDPPlus *server = new UDPPlus(MAXCONNECTIONS + 1, 16);
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons(PORT);
+  inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+  server->bind_p((struct sockaddr *) &address, sizeof(address));
+
+  vector<UDPPlusConnection*> accepted;
+  boost::thread acceptThread(boost::bind(&acceptor, server, MAXCONNECTIONS, &accepted));
+
+  long baseRss = readStatus("VmRSS");
+  cout << "connections\trss KB\tKB/conn\tthreads\tidle cpu %" << endl;
+  int opened = 0;
+  for (size_t s = 0; s < sizeof(steps) / sizeof(steps[0]); s++) {
+    for (; opened < steps[s]; opened++) {
+      if (!handshake(opened, address)) {
+        cerr << "handshake " << opened << " failed" << endl;
+      }
+    }
+    // let the last SYN-ACKs be released before measuring
+    boost::this_thread::sleep(milliseconds(200));
+
+    double cpuStart = cpuSeconds();
+    ptime start = microsec_clock::universal_time();
+    boost::this_thread::sleep(seconds(IDLESECONDS));
+    double wall = (microsec_clock::universal_time() - start).total_microseconds() / 1000000.0;
+    double cpu = cpuSeconds() - cpuStart;
+
+    long rss = readStatus("VmRSS");
+    cout << opened << "\t\t" << rss << "\t" << (double) (rss - baseRss) / opened << "\t"
+         << readStatus("Threads") << "\t" << 100.0 * cpu / wall << endl;
+  }
+  acceptThread.join();
+
+  // closing would retransmit a FIN to every departed client
+  // until it gives up, which says nothing about idle cost
+  cout.flush();
+  _exit(0);
+}
@@ -0,0 +1,153 @@
+/*
+ * bench_impairment.cpp
+ *
+ *  Created on: Oct 16, 2026
+ *
+ *  Transfers a fixed number of messages between two UDPPlus
+ *  objects joined by a NetworkEmulator and reports how long
+ *  the transfer took, goodput, p99 one-way latency and how
+ *  much recovery it needed, sweeping loss rate and delay over
+ *  a 100 Mbit/s link with some jitter, duplication and
+ *  reordering.  The emulator's seed makes runs comparable.
+ *
+ *  usage: bench_impairment [messages per run] [results file]
+ *  results are written as a JSON array, bench_impairment.json
+ *  by default.
+ */
+
+#include "utility.h"
+#include "UDPPlus.h"
+#include "UDPPlusConnection.h"
+#include "NetworkEmulator.h"
+
+#include <algorithm>
+
+using namespace boost::posix_time;
+
+const size_t PAYLOAD = 1000;
+const uint32_t SEED = 2010;
+
+struct Result {
+  double loss;
+  time_duration delay;
+  int messages;
+  double seconds;
+  double p99;           // microseconds
+  ConnectionStats sender;
+  EmulatorStats network;
+};
+
+int64_t nowNanos() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (int64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+void sender(UDPPlusConnection *connection, int messages) {
+  vector<char> message(PAYLOAD, 'x');
+  for (int i = 0; i < messages; i++) {
+    int64_t stamp = nowNanos();
+    memcpy(&message[0], &stamp, sizeof(stamp));
+    if (connection->send(&message[0], message.size()) < 0) {
+      break;
+    }
+  }
+  connection->closeConnection();
+}
+
+Result run(double loss, time_duration delay, int messages) {
+  Result result;
+  result.loss = loss;
+  result.delay = delay;
+
+  NetworkEmulator network(SEED);
+  Impairment impairment;
+  impairment.loss = loss;
+  impairment.delay = delay;
+  impairment.jitter = delay / 10;
+  impairment.duplicate = 0.001;
+  impairment.reorder = 0.001;
+  impairment.bandwidth = 12.5e6;
+  network.setImpairment(impairment);
+
+  EmulatedPair pair(network, 9000, 1024, 1024);
+
+  int64_t start = nowNanos();
+  if (!pair.open()) {
+    printf("error connecting over the emulator\n");
+    exit(1);
+  }
+  UDPPlusConnection *outgoing = pair.outgoing;
+  UDPPlusConnection *incoming = pair.incoming;
+  boost::thread sending(boost::bind(&sender, outgoing, messages));
+
+  vector<int64_t> latencies;
+  PayloadView view;
+  while (incoming->recv(view) == 0) {
+    int64_t stamp;
+    memcpy(&stamp, view.data, sizeof(stamp));
+    latencies.push_back(nowNanos() - stamp);
+  }
+  view.release();
+  int64_t end = nowNanos();
+  incoming->closeConnection();
+  sending.join();
+
+  result.messages = latencies.size();
+  result.seconds = (end - start) / 1e9;
+  result.p99 = 0;
+  if (!latencies.empty()) {
+    size_t rank = (size_t) (0.99 * (latencies.size() - 1));
+    nth_element(latencies.begin(), latencies.begin() + rank, latencies.end());
+    result.p99 = latencies[rank] / 1000.0;
+  }
+  result.sender = outgoing->getStats();
+  result.network = network.getStats();
+  return result;
+}
+
+void writeJson(ostream &out, const Result &r) {
+  out << "{\"loss\":" << r.loss << ",\"delay_us\":" << r.delay.total_microseconds()
+      << ",\"messages\":" << r.messages << ",\"seconds\":" << r.seconds
+      << ",\"goodput_mbps\":" << (r.seconds > 0 ? r.messages * PAYLOAD * 8 / r.seconds / 1e6 : 0)
+      << ",\"p99_us\":" << r.p99
+      << ",\"packets_sent\":" << r.sender.packetsSent << ",\"retransmits\":" << r.sender.retransmits
+      << ",\"timeouts\":" << r.sender.timeouts << ",\"dup_ack_events\":" << r.sender.dupAckEvents
+      << ",\"sack_resends\":" << r.sender.sackResends
+      << ",\"network_lost\":" << r.network.lost << ",\"network_overflowed\":" << r.network.overflowed
+      << ",\"network_duplicated\":" << r.network.duplicated
+      << ",\"network_reordered\":" << r.network.reordered << "}";
+}
+
+int main(int argc, char* argv[]) {
+  double losses[] = { 0, 0.005, 0.01, 0.02, 0.05 };
+  time_duration delays[] = { milliseconds(1), milliseconds(10) };
+  int messages = (argc > 1) ? atoi(argv[1]) : 5000;
+  string resultsFile = (argc > 2) ? argv[2] : "bench_impairment.json";
+
+  ofstream results(resultsFile.c_str());
+  if (!results) {
+    printf("error opening %s\n", resultsFile.c_str());
+    exit(1);
+  }
+  results << "[";
+  cout << "loss %\tdelay ms\tseconds\tMbit/s\tp99 us\tretx\ttimeouts\tdup acks\tsack resends" << endl;
+  bool first = true;
+  for (size_t d = 0; d < sizeof(delays) / sizeof(delays[0]); d++) {
+    for (size_t l = 0; l < sizeof(losses) / sizeof(losses[0]); l++) {
+      Result r = run(losses[l], delays[d], messages);
+      results << (first ? "\n  " : ",\n  ");
+      writeJson(results, r);
+      first = false;
+
+      printf("%.1f\t%ld\t\t%.2f\t%.1f\t%.0f\t%llu\t%llu\t\t%llu\t\t%llu\n",
+          100 * r.loss, (long) r.delay.total_milliseconds(), r.seconds,
+          r.seconds > 0 ? r.messages * PAYLOAD * 8 / r.seconds / 1e6 : 0, r.p99,
+          (unsigned long long) r.sender.retransmits, (unsigned long long) r.sender.timeouts,
+          (unsigned long long) r.sender.dupAckEvents, (unsigned long long) r.sender.sackResends);
+      fflush(stdout);
+    }
+  }
+  results << "\n]\n";
+  return 0;
+}
@@ -0,0 +1,230 @@
+/*
+ * bench_transport.cpp
+ *
+ *  Created on: Oct 16, 2026
+ *
+ *  Runs UDP+ clients against a UDPPlus server in one process
+ *  over loopback and reports goodput, messages per second,
+ *  one-way latency percentiles, the retransmit ratio and CPU
+ *  seconds per GB delivered, sweeping the message size, the
+ *  window (bufferSize) and the number of connections.
+ *
+ *  Every client sends as fast as the window allows for the
+ *  run's duration, so latency includes queueing behind the
+ *  window.  CPU time is the whole process, both ends.
+ *
+ *  usage: bench_transport [milliseconds per run] [results file]
+ *  results are written as a JSON array, bench_transport.json
+ *  by default.
+ */
+
+#include "utility.h"
+#include "UDPPlus.h"
+#include "UDPPlusConnection.h"
+
+#include <algorithm>
+#include <sys/resource.h>
+
+using namespace boost::posix_time;
+
+const int PORT = 9670;
+// room for the send timestamp
+const size_t MINPAYLOAD = sizeof(int64_t);
+
+struct Result {
+  size_t payload;
+  int window;
+  int connections;
+  double seconds;
+  uint64_t messages;
+  uint64_t bytes;
+  double p50;           // microseconds
+  double p99;
+  double p999;
+  uint64_t packetsSent;
+  uint64_t retransmits;
+  double cpuSeconds;
+};
+
+int64_t nowNanos() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (int64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+double cpuSeconds() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+      (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000000.0;
+}
+
+void acceptor(UDPPlus *server, int count, vector<UDPPlusConnection*> *accepted) {
+  for (int i = 0; i < count; i++) {
+    accepted->push_back(server->accept_p());
+  }
+}
+
+// sends timestamped messages until the deadline, then closes
+void sender(UDPPlusConnection *connection, size_t payload, int64_t deadline) {
+  vector<char> message(payload, 'x');
+  while (nowNanos() < deadline) {
+    int64_t stamp = nowNanos();
+    memcpy(&message[0], &stamp, sizeof(stamp));
+    if (connection->send(&message[0], payload) < 0) {
+      break;
+    }
+  }
+  connection->closeConnection();
+}
+
+// receives until the client closes, recording one-way latency
+// in nanoseconds and the time of the last message
+void receiver(UDPPlusConnection *connection,
+    vector<int64_t> *latencies, uint64_t *bytes, int64_t *last) {
+  PayloadView view;
+  while (connection->recv(view) == 0) {
+    int64_t now = nowNanos();
+    int64_t stamp;
+    memcpy(&stamp, view.data, sizeof(stamp));
+    latencies->push_back(now - stamp);
+    *bytes += view.length;
+    *last = now;
+  }
+  view.release();
+  connection->closeConnection();
+}
+
+double percentile(vector<int64_t> &samples, double q) {
+  if (samples.empty()) {
+    return 0;
+  }
+  size_t rank = (size_t) (q * (samples.size() - 1));
+  nth_element(samples.begin(), samples.begin() + rank, samples.end());
+  return samples[rank] / 1000.0;
+}
+
+Result run(int port, size_t payload, int window, int connections, int milliseconds) {
+  Result result;
+  result.payload = payload;
+  result.window = window;
+  result.connections = connections;
+
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+
+  UDPPlus *server = new UDPPlus(connections, window);
+  server->bind_p((struct sockaddr *) &address, sizeof(address));
+  vector<UDPPlusConnection*> accepted;
+  boost::thread acceptThread(boost::bind(&acceptor, server, connections, &accepted));
+
+  vector<UDPPlus*> clients;
+  vector<UDPPlusConnection*> connected;
+  for (int i = 0; i < connections; i++) {
+    clients.push_back(new UDPPlus(1, window));
+    connected.push_back(clients[i]->conn((struct sockaddr *) &address, sizeof(address)));
+  }
+  acceptThread.join();
+
+  vector<vector<int64_t> > latencies(connections);
+  vector<uint64_t> bytes(connections, 0);
+  vector<int64_t> last(connections, 0);
+  double cpuStart = cpuSeconds();
+  int64_t start = nowNanos();
+  int64_t deadline = start + (int64_t) milliseconds * 1000000;
+  boost::thread_group threads;
+  for (int i = 0; i < connections; i++) {
+    threads.create_thread(boost::bind(&receiver, accepted[i], &latencies[i], &bytes[i], &last[i]));
+    threads.create_thread(boost::bind(&sender, connected[i], payload, deadline));
+  }
+  threads.join_all();
+  result.cpuSeconds = cpuSeconds() - cpuStart;
+
+  vector<int64_t> samples;
+  result.bytes = 0;
+  int64_t end = start;
+  for (int i = 0; i < connections; i++) {
+    samples.insert(samples.end(), latencies[i].begin(), latencies[i].end());
+    result.bytes += bytes[i];
+    end = max(end, last[i]);
+  }
+  result.messages = samples.size();
+  result.seconds = (end - start) / 1e9;
+  result.p50 = percentile(samples, 0.5);
+  result.p99 = percentile(samples, 0.99);
+  result.p999 = percentile(samples, 0.999);
+
+  result.packetsSent = 0;
+  result.retransmits = 0;
+  for (int i = 0; i < connections; i++) {
+    ConnectionStats stats = connected[i]->getStats();
+    result.packetsSent += stats.packetsSent;
+    result.retransmits += stats.retransmits;
+  }
+
+  for (int i = 0; i < connections; i++) {
+    delete connected[i];
+    delete clients[i];
+    delete accepted[i];
+  }
+  delete server;
+  return result;
+}
+
+void writeJson(ostream &out, const Result &r) {
+  double gigabytes = r.bytes / 1e9;
+  out << "{\"payload\":" << r.payload << ",\"window\":" << r.window
+      << ",\"connections\":" << r.connections << ",\"seconds\":" << r.seconds
+      << ",\"messages\":" << r.messages << ",\"bytes\":" << r.bytes
+      << ",\"goodput_mbps\":" << (r.seconds > 0 ? r.bytes * 8 / r.seconds / 1e6 : 0)
+      << ",\"messages_per_second\":" << (r.seconds > 0 ? r.messages / r.seconds : 0)
+      << ",\"p50_us\":" << r.p50 << ",\"p99_us\":" << r.p99 << ",\"p999_us\":" << r.p999
+      << ",\"packets_sent\":" << r.packetsSent << ",\"retransmits\":" << r.retransmits
+      << ",\"retransmit_ratio\":" << (r.packetsSent > 0 ? (double) r.retransmits / r.packetsSent : 0)
+      << ",\"cpu_seconds\":" << r.cpuSeconds
+      << ",\"cpu_seconds_per_gb\":" << (gigabytes > 0 ? r.cpuSeconds / gigabytes : 0) << "}";
+}
+
+int main(int argc, char* argv[]) {
+  size_t payloads[] = { 64, 1024, 8192 };
+  int windows[] = { 64, 1024 };
+  int connectionCounts[] = { 1, 4, 16 };
+  int milliseconds = (argc > 1) ? atoi(argv[1]) : 1000;
+  string resultsFile = (argc > 2) ? argv[2] : "bench_transport.json";
+
+  ofstream results(resultsFile.c_str());
+  if (!results) {
+    printf("error opening %s\n", resultsFile.c_str());
+    exit(1);
+  }
+  results << "[";
+  cout << "payload\twindow\tconns\tMbit/s\tmsg/s\tp50 us\tp99 us\tp999 us\tretx %\tcpu s/GB" << endl;
+  int port = PORT;
+  bool first = true;
+  for (size_t p = 0; p < sizeof(payloads) / sizeof(payloads[0]); p++) {
+    for (size_t w = 0; w < sizeof(windows) / sizeof(windows[0]); w++) {
+      for (size_t c = 0; c < sizeof(connectionCounts) / sizeof(connectionCounts[0]); c++) {
+        size_t payload = max(payloads[p], MINPAYLOAD);
+        // a fresh port each run, the last one's may still be draining
+        Result r = run(port++, payload, windows[w], connectionCounts[c], milliseconds);
+        results << (first ? "\n  " : ",\n  ");
+        writeJson(results, r);
+        first = false;
+
+        double gigabytes = r.bytes / 1e9;
+        printf("%lu\t%d\t%d\t%.1f\t%.0f\t%.0f\t%.0f\t%.0f\t%.3f\t%.2f\n",
+            (unsigned long) r.payload, r.window, r.connections,
+            r.seconds > 0 ? r.bytes * 8 / r.seconds / 1e6 : 0,
+            r.seconds > 0 ? r.messages / r.seconds : 0, r.p50, r.p99, r.p999,
+            r.packetsSent > 0 ? 100.0 * r.retransmits / r.packetsSent : 0,
+            gigabytes > 0 ? r.cpuSeconds / gigabytes : 0);
+        fflush(stdout);
+      }
+    }
+  }
+  results << "\n]\n";
+  return 0;
+}
@@ -18,7 +18,6 @@ int main(int argc, char* argv[]) {
   UDPPlusConnection *open;
   int role = 0;
   const int PORT = 9555;
-  boost::thread *myThread;
 
   
   // determine if this will be a server or client application
@@ -97,16 +96,18 @@ void sender(UDPPlusConnection *open) {
 }
 
 void reciever(UDPPlusConnection *conn) {
-  char buf[2048];
+  PayloadView view;
   
   //cout << "Reciever Thread Started" << endl;
   while (true) {
-    int value = conn->recv(buf, sizeof(buf));
+    int value = conn->recv(view);
     //cerr << "Reciever Return Value:" << value << endl;
     if ( value == -1 ) {
       printf("connection closed");
       return;
     }
-    cout << buf << endl;
+    cout.write(view.data, view.length);
+    cout << endl;
+    view.release();
   }
 }
@@ -0,0 +1,35 @@
+/*
+ * test.h
+ *
+ *  Created on: Oct 16, 2026
+ *
+ *  Checks shared by the test_* programs.  CHECK prints a
+ *  condition that does not hold and counts it; a test's main
+ *  returns testResult(), which ctest takes as its verdict.
+ */
+
+#ifndef TEST_H_
+#define TEST_H_
+
+#include "utility.h"
+
+static int testFailures = 0;
+
+#define CHECK(condition) \
+  do { \
+    if (!(condition)) { \
+      printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+      testFailures++; \
+    } \
+  } while (0)
+
+static int testResult() {
+  if (testFailures != 0) {
+    printf("%d checks failed\n", testFailures);
+    return 1;
+  }
+  printf("all checks passed\n");
+  return 0;
+}
+
+#endif /* TEST_H_ */
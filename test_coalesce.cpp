@@ -0,0 +1,108 @@
+/*
+ * test_coalesce.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *
+ *  Sends many small messages with coalescing on through a lossy,
+ *  reordering NetworkEmulator, with now and then one too large to
+ *  share a packet, and checks that they go out in far fewer
+ *  packets than messages and that recv still returns each one
+ *  whole, once and in order, through both of its forms.  Views
+ *  held across later recv calls must keep their bytes.
+ */
+
+#include "test.h"
+#include "UDPPlus.h"
+#include "UDPPlusConnection.h"
+#include "NetworkEmulator.h"
+
+const int MESSAGES = 20000;
+const size_t COALESCEMTU = 1200;
+// sent on its own, after the messages pending before it
+const size_t LARGE = 3000;
+// views the reader keeps before checking them again
+const int HELD = 16;
+
+static size_t sizeOf(int message) {
+  return (message % 1000 == 999) ? LARGE : 5 + message % 37;
+}
+
+// true if data holds the bytes message was sent with
+static bool intact(int message, const char *data, size_t length) {
+  int index;
+  if (length != sizeOf(message) || length < sizeof(index)) {
+    return false;
+  }
+  memcpy(&index, data, sizeof(index));
+  return index == message && data[length - 1] == (char) (message & 0xFF);
+}
+
+static int received = 0;
+static bool inOrder = true;
+
+// reads half the messages with recv into a buffer, half as views
+static void reader(UDPPlusConnection *incoming) {
+  char buffer[LARGE];
+  vector<PayloadView> views(HELD);
+  while (received < MESSAGES) {
+    if (received % 2 == 0) {
+      if (incoming->recv(buffer, sizeof(buffer)) != 0) {
+        return;
+      }
+      inOrder = inOrder && intact(received, buffer, sizeOf(received));
+    }
+    else {
+      PayloadView &view = views[(received / 2) % HELD];
+      view.release();
+      if (incoming->recv(view) != 0) {
+        return;
+      }
+      inOrder = inOrder && intact(received, view.data, view.length);
+      // the view read HELD - 1 odd messages ago, still unreleased
+      int earlier = received - 2 * (HELD - 1);
+      if (earlier > 0) {
+        PayloadView &old = views[(earlier / 2) % HELD];
+        inOrder = inOrder && intact(earlier, old.data, old.length);
+      }
+    }
+    received++;
+  }
+  for (int i = 0; i < HELD; i++) {
+    views[i].release();
+  }
+}
+
+int main(int argc, char **argv) {
+  NetworkEmulator network;
+  Impairment impairment;
+  impairment.delay = boost::posix_time::milliseconds(1);
+  impairment.loss = 0.01;
+  impairment.reorder = 0.01;
+  impairment.reorderDelay = boost::posix_time::milliseconds(2);
+  network.setImpairment(impairment);
+
+  EmulatedPair pair(network, 9000);
+  CHECK(pair.open());
+  UDPPlusConnection *outgoing = pair.outgoing;
+  UDPPlusConnection *incoming = pair.incoming;
+  outgoing->setCoalescing(COALESCEMTU);
+  boost::thread thread(&reader, incoming);
+
+  vector<char> message(LARGE);
+  for (int i = 0; i < MESSAGES; i++) {
+    memset(&message[0], i & 0xFF, sizeOf(i));
+    memcpy(&message[0], &i, sizeof(i));
+    CHECK(outgoing->send(&message[0], sizeOf(i)) == 0);
+  }
+  CHECK(outgoing->flush() == 0);
+  thread.join();
+  CHECK(received == MESSAGES);
+  CHECK(inOrder);
+
+  // about fifty small messages share each packet
+  ConnectionStats stats = outgoing->getStats();
+  CHECK(stats.packetsSent < (uint64_t) MESSAGES / 10);
+  CHECK(stats.retransmits > 0);
+
+  return testResult();
+}
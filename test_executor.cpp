@@ -0,0 +1,183 @@
+/*
+ * test_executor.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *
+ *  Runs an echo server and several clients as coroutines on one
+ *  Executor, all on the main thread, over a NetworkEmulator with
+ *  some loss.  The server takes its connections with async_accept
+ *  and serves each in a session of its own; every client writes
+ *  with one session and reads the echoes with another.  Checks
+ *  that every echo comes back whole and in order, and that run
+ *  returns once each session has finished.  A session ended by an
+ *  exception must be logged and leave the others running.
+ */
+
+#include "test.h"
+#include "UDPPlus.h"
+#include "UDPPlusConnection.h"
+#include "NetworkEmulator.h"
+#include "Executor.h"
+#include "Logger.h"
+
+#include <stdexcept>
+
+#ifdef UDPPLUS_COROUTINES
+
+const int CLIENTS = 4;
+const int MESSAGES = 300;
+const size_t PAYLOAD = 200;
+
+static int finished = 0;
+
+static void fill(vector<char> &message, int client, int index) {
+  memset(&message[0], (client * MESSAGES + index) & 0xFF, message.size());
+  memcpy(&message[0], &index, sizeof(index));
+}
+
+static Task<void> failing() {
+  co_await Executor::yield();
+  throw std::runtime_error("session failed");
+}
+
+static Task<void> surviving() {
+  co_await Executor::yield();
+  co_await Executor::yield();
+  finished++;
+}
+
+// true if the log written to out holds text
+static bool logged(FILE *out, const char *text) {
+  rewind(out);
+  char line[Logger::TEXTSIZE * 2];
+  while (fgets(line, sizeof(line), out) != NULL) {
+    if (strstr(line, text) != NULL) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// sends back everything it receives until the peer closes
+static Task<void> echo(UDPPlusConnection *connection) {
+  PayloadView view;
+  while (true) {
+    int result = co_await connection->async_recv(view);
+    if (result != 0) {
+      CHECK(errno == ENOTCONN);
+      break;
+    }
+    result = co_await connection->async_send(view.data, view.length);
+    CHECK(result == 0);
+    view.release();
+  }
+  connection->closeConnection();
+  finished++;
+}
+
+static Task<void> acceptor(UDPPlus *server, vector<UDPPlusConnection*> *accepted) {
+  for (int i = 0; i < CLIENTS; i++) {
+    UDPPlusConnection *connection = co_await server->async_accept();
+    CHECK(connection != NULL);
+    if (connection == NULL) {
+      break;
+    }
+    accepted->push_back(connection);
+    Executor::current()->spawn(echo(connection));
+  }
+  finished++;
+}
+
+static Task<void> writer(UDPPlusConnection *connection, int client) {
+  vector<char> message(PAYLOAD);
+  for (int i = 0; i < MESSAGES; i++) {
+    fill(message, client, i);
+    int result = co_await connection->async_send(&message[0], message.size());
+    CHECK(result == 0);
+  }
+  finished++;
+}
+
+static Task<void> reader(UDPPlusConnection *connection, int client) {
+  vector<char> expected(PAYLOAD);
+  vector<char> buffer(PAYLOAD);
+  int received = 0;
+  bool inOrder = true;
+  while (received < MESSAGES) {
+    int result = co_await connection->async_recv(&buffer[0], buffer.size());
+    if (result != 0) {
+      break;
+    }
+    fill(expected, client, received);
+    inOrder = inOrder && buffer == expected;
+    received++;
+  }
+  CHECK(received == MESSAGES);
+  CHECK(inOrder);
+  connection->closeConnection();
+  finished++;
+}
+
+int main(int argc, char **argv) {
+  FILE *log = tmpfile();
+  Logger::setOutput(log);
+  {
+    Executor executor;
+    executor.spawn(failing());
+    executor.spawn(surviving());
+    executor.run();
+  }
+  Logger::flush();
+  Logger::setOutput(stderr);
+  CHECK(finished == 1);
+  CHECK(logged(log, "session failed"));
+  fclose(log);
+  finished = 0;
+
+  NetworkEmulator network;
+  Impairment impairment;
+  impairment.delay = boost::posix_time::milliseconds(1);
+  impairment.loss = 0.01;
+  network.setImpairment(impairment);
+
+  EmulatedPair pair(network, 9000, 64, 64, CLIENTS);
+  // connections opened before run queue for async_accept
+  CHECK(pair.server->getEventFd() >= 0);
+
+  vector<UDPPlusConnection*> outgoing;
+  outgoing.push_back(pair.connect());
+  while ((int) outgoing.size() < CLIENTS) {
+    outgoing.push_back(pair.connectAnother());
+  }
+
+  vector<UDPPlusConnection*> accepted;
+  {
+    Executor executor;
+    CHECK(Executor::current() == NULL);
+    executor.spawn(acceptor(pair.server, &accepted));
+    for (int i = 0; i < CLIENTS; i++) {
+      executor.spawn(writer(outgoing[i], i));
+      executor.spawn(reader(outgoing[i], i));
+    }
+    executor.run();
+    CHECK(Executor::current() == NULL);
+  }
+  // the acceptor, an echo per client, a writer and a reader each
+  CHECK(finished == 1 + 3 * CLIENTS);
+  CHECK((int) accepted.size() == CLIENTS);
+
+  // the pair deletes the rest, these must go before its server
+  for (size_t i = 0; i < accepted.size(); i++) {
+    delete accepted[i];
+  }
+  return testResult();
+}
+
+#else
+
+int main(int argc, char **argv) {
+  printf("coroutines not supported, nothing to test\n");
+  return 0;
+}
+
+#endif
@@ -0,0 +1,117 @@
+/*
+ * test_fragment.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *
+ *  Sends messages from empty to a megabyte through a NetworkEmulator
+ *  that drops, duplicates and reorders datagrams, and checks that
+ *  each one is reassembled byte for byte, once and in order,
+ *  through both forms of recv.  A buffer too short for its message
+ *  gets the message's first bytes and EMSGSIZE, and the messages
+ *  after it are unaffected.
+ */
+
+#include "test.h"
+#include "UDPPlus.h"
+#include "UDPPlusConnection.h"
+#include "NetworkEmulator.h"
+
+// around the 1200 byte starting MTU and well past it
+const size_t SIZES[] = { 0, 1, 1100, 1200, 1300, 5000, 65536, 300000, 1000000 };
+const int KINDS = sizeof(SIZES) / sizeof(SIZES[0]);
+const int ROUNDS = 4;
+const int MESSAGES = KINDS * ROUNDS;
+// read into a buffer this short, then resent whole
+const size_t SHORT = 100;
+
+static size_t sizeOf(int message) {
+  return SIZES[message % KINDS];
+}
+
+static char byteOf(int message, size_t offset) {
+  return (char) ((message * 31 + offset) & 0xFF);
+}
+
+// true if data holds the bytes message was sent with
+static bool intact(int message, const char *data, size_t length) {
+  if (length != sizeOf(message)) {
+    return false;
+  }
+  for (size_t i = 0; i < length; i++) {
+    if (data[i] != byteOf(message, i)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void sender(UDPPlusConnection *outgoing) {
+  vector<char> message(SIZES[KINDS - 1]);
+  for (int i = 0; i < MESSAGES; i++) {
+    for (size_t j = 0; j < sizeOf(i); j++) {
+      message[j] = byteOf(i, j);
+    }
+    CHECK(outgoing->send(&message[0], sizeOf(i)) == 0);
+  }
+  // once more, for the reader to take into a short buffer
+  CHECK(outgoing->send(&message[0], sizeOf(MESSAGES - 1)) == 0);
+  CHECK(outgoing->send("end", 3) == 0);
+}
+
+int main(int argc, char **argv) {
+  NetworkEmulator network;
+  Impairment impairment;
+  impairment.delay = boost::posix_time::milliseconds(1);
+  impairment.loss = 0.02;
+  impairment.duplicate = 0.01;
+  impairment.reorder = 0.05;
+  impairment.reorderDelay = boost::posix_time::milliseconds(3);
+  network.setImpairment(impairment);
+
+  EmulatedPair pair(network, 9000);
+  CHECK(pair.open());
+  UDPPlusConnection *outgoing = pair.outgoing;
+  UDPPlusConnection *incoming = pair.incoming;
+  boost::thread thread(&sender, outgoing);
+
+  // alternates between the two forms of recv
+  vector<char> buffer(SIZES[KINDS - 1]);
+  int received = 0;
+  bool inOrder = true;
+  for (; received < MESSAGES; received++) {
+    if (received % 2 == 0) {
+      if (incoming->recv(&buffer[0], sizeOf(received)) != 0) {
+        break;
+      }
+      inOrder = inOrder && intact(received, &buffer[0], sizeOf(received));
+    }
+    else {
+      PayloadView view;
+      if (incoming->recv(view) != 0) {
+        break;
+      }
+      inOrder = inOrder && intact(received, view.data, view.length);
+    }
+  }
+  CHECK(received == MESSAGES);
+  CHECK(inOrder);
+
+  // the short buffer holds the start of the message, the rest is dropped
+  char start[SHORT];
+  CHECK(incoming->recv(start, sizeof(start)) == -1 && errno == EMSGSIZE);
+  bool prefix = true;
+  for (size_t i = 0; i < SHORT; i++) {
+    prefix = prefix && start[i] == byteOf(MESSAGES - 1, i);
+  }
+  CHECK(prefix);
+  PayloadView end;
+  CHECK(incoming->recv(end) == 0 && end.length == 3 && memcmp(end.data, "end", 3) == 0);
+  end.release();
+  thread.join();
+
+  // the lossy link made fragments go missing and arrive late
+  CHECK(outgoing->getStats().retransmits > 0);
+  CHECK(incoming->getStats().reordered > 0);
+
+  return testResult();
+}
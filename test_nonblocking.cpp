@@ -0,0 +1,124 @@
+/*
+ * test_nonblocking.cpp
+ *
+ *  Created on: Oct 16, 2026
+ *
+ *  Serves one connection from a single thread with try_accept,
+ *  try_send and try_recv, waiting in poll on their event
+ *  descriptors, and checks that every message, fragmented ones
+ *  included, arrives once and in order and that the calls
+ *  report EAGAIN and ENOTCONN when they should.
+ */
+
+#include "test.h"
+#include "UDPPlus.h"
+#include "UDPPlusConnection.h"
+#include "NetworkEmulator.h"
+
+#include <poll.h>
+
+const int MESSAGES = 2000;
+const size_t SMALL = 100;
+// sent as fragments
+const size_t LARGE = 5000;
+
+static size_t sizeOf(int message) {
+  return (message % 50 == 49) ? LARGE : SMALL;
+}
+
+// true if fd turns readable within timeout milliseconds
+static bool readable(int fd, int timeout) {
+  struct pollfd p;
+  p.fd = fd;
+  p.events = POLLIN;
+  p.revents = 0;
+  return poll(&p, 1, timeout) == 1;
+}
+
+int main(int argc, char **argv) {
+  NetworkEmulator network;
+  Impairment impairment;
+  impairment.delay = boost::posix_time::milliseconds(1);
+  network.setImpairment(impairment);
+
+  EmulatedPair pair(network, 9000, 64, 64);
+
+  // from here new connections queue for try_accept
+  int acceptFd = pair.server->getEventFd();
+  CHECK(acceptFd >= 0);
+  CHECK(pair.server->try_accept() == NULL && errno == EAGAIN);
+  CHECK(!readable(acceptFd, 0));
+
+  UDPPlusConnection *outgoing = pair.connect();
+  CHECK(outgoing != NULL);
+  CHECK(readable(acceptFd, 5000));
+  UDPPlusConnection *incoming = pair.incoming = pair.server->try_accept();
+  CHECK(incoming != NULL);
+  if (outgoing == NULL || incoming == NULL) {
+    return testResult();
+  }
+
+  int recvFd = incoming->getRecvEventFd();
+  int sendFd = outgoing->getSendEventFd();
+  char buffer[LARGE];
+  CHECK(incoming->try_recv(buffer, sizeof(buffer)) < 0 && errno == EAGAIN);
+
+  int sent = 0;
+  int received = 0;
+  int blocked = 0;
+  bool inOrder = true;
+  vector<char> message(LARGE);
+  while (received < MESSAGES) {
+    struct pollfd fds[2];
+    fds[0].fd = recvFd;
+    fds[1].fd = sendFd;
+    fds[0].events = fds[1].events = POLLIN;
+    fds[0].revents = fds[1].revents = 0;
+    int watched = (sent < MESSAGES) ? 2 : 1;
+    if (poll(fds, watched, 5000) <= 0) {
+      CHECK(!"poll timed out");
+      break;
+    }
+    while (sent < MESSAGES && (fds[1].revents & POLLIN)) {
+      memset(&message[0], sent & 0xFF, sizeOf(sent));
+      memcpy(&message[0], &sent, sizeof(sent));
+      if (outgoing->try_send(&message[0], sizeOf(sent)) < 0) {
+        CHECK(errno == EAGAIN);
+        blocked++;
+        break;
+      }
+      sent++;
+    }
+    while (fds[0].revents & POLLIN) {
+      PayloadView view;
+      if (incoming->try_recv(view) < 0) {
+        CHECK(errno == EAGAIN);
+        break;
+      }
+      int index;
+      memcpy(&index, view.data, sizeof(index));
+      inOrder = inOrder && index == received && view.length == sizeOf(index) &&
+          view.data[view.length - 1] == (char) (index & 0xFF);
+      received++;
+    }
+  }
+  CHECK(sent == MESSAGES);
+  CHECK(received == MESSAGES);
+  CHECK(inOrder);
+  // a 64 packet window cannot take every message at once
+  CHECK(blocked > 0);
+
+  // the peer's FIN turns try_recv from EAGAIN to ENOTCONN
+  outgoing->closeConnection();
+  CHECK(outgoing->try_send(buffer, SMALL) < 0 && errno == ENOTCONN);
+  int result = 0;
+  while (readable(recvFd, 5000)) {
+    result = incoming->try_recv(buffer, sizeof(buffer));
+    if (result == 0 || errno != EAGAIN) {
+      break;
+    }
+  }
+  CHECK(result < 0 && errno == ENOTCONN);
+  incoming->closeConnection();
+  return testResult();
+}
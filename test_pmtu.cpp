@@ -0,0 +1,86 @@
+/*
+ * test_pmtu.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *
+ *  Opens a connection over a NetworkEmulator link that refuses
+ *  datagrams longer than 1400 bytes, short of the ethernet size
+ *  probed first, and checks that path MTU discovery settles just
+ *  under that limit and never above it, and that the messages
+ *  fragmented to the size it found all arrive.
+ *  With discovery off the connection keeps to 1200 bytes.
+ */
+
+#include "test.h"
+#include "UDPPlus.h"
+#include "UDPPlusConnection.h"
+#include "NetworkEmulator.h"
+
+using namespace boost::posix_time;
+
+const size_t PATHMTU = 1400;
+const size_t BASEMTU = 1200;
+// the search stops once it is this close
+const size_t SEARCHSTEP = 16;
+const int MESSAGES = 200;
+// a few fragments each
+const size_t PAYLOAD = 4000;
+
+// sends count messages of length bytes and reads them back
+// returns the number that arrived intact
+static int exchange(EmulatedPair &pair, int count, size_t length) {
+  vector<char> message(length);
+  vector<char> buffer(length);
+  int received = 0;
+  for (int i = 0; i < count; i++) {
+    memset(&message[0], i & 0xFF, length);
+    if (pair.outgoing->send(&message[0], length) != 0 ||
+        pair.incoming->recv(&buffer[0], length) != 0) {
+      break;
+    }
+    if (buffer == message) {
+      received++;
+    }
+  }
+  return received;
+}
+
+int main(int argc, char **argv) {
+  NetworkEmulator network;
+  Impairment impairment;
+  impairment.delay = milliseconds(1);
+  impairment.mtu = PATHMTU;
+  network.setImpairment(impairment);
+
+  EmulatedPair pair(network, 9000);
+  CHECK(pair.open());
+  // a round trip estimate first, the probes wait for it
+  CHECK(exchange(pair, 10, 100) == 10);
+
+  // unanswered probes take a few retransmission timeouts each
+  ptime deadline = microsec_clock::universal_time() + seconds(10);
+  size_t mtu = BASEMTU;
+  while (mtu <= PATHMTU - SEARCHSTEP && microsec_clock::universal_time() < deadline) {
+    boost::this_thread::sleep(milliseconds(10));
+    mtu = pair.outgoing->getStats().mtu;
+    CHECK(mtu <= PATHMTU);
+  }
+  CHECK(mtu > PATHMTU - SEARCHSTEP);
+  CHECK(mtu <= PATHMTU);
+
+  // fragments of the size found all fit the path, one that did
+  // not would be lost however often it was resent, until the
+  // timeouts dropped the connection back to 1200 bytes
+  CHECK(exchange(pair, MESSAGES, PAYLOAD) == MESSAGES);
+  mtu = pair.outgoing->getStats().mtu;
+  CHECK(mtu > PATHMTU - SEARCHSTEP);
+  CHECK(mtu <= PATHMTU);
+
+  EmulatedPair fixed(network, 9001);
+  CHECK(fixed.open());
+  fixed.outgoing->setMtuDiscovery(false);
+  CHECK(exchange(fixed, MESSAGES, PAYLOAD) == MESSAGES);
+  boost::this_thread::sleep(milliseconds(500));
+  CHECK(fixed.outgoing->getStats().mtu == BASEMTU);
+  return testResult();
+}
@@ -0,0 +1,146 @@
+/*
+ * test_recovery.cpp
+ *
+ *  Created on: Oct 16, 2026
+ *
+ *  Transfers messages through a NetworkEmulator and checks
+ *  that every one arrives once and in order, and that loss
+ *  recovery resends about as much as the network lost rather
+ *  than resending on every ack, which is how a spurious
+ *  recovery once showed up on a link that lost nothing.
+ */
+
+#include "test.h"
+#include "UDPPlus.h"
+#include "UDPPlusConnection.h"
+#include "NetworkEmulator.h"
+
+using namespace boost::posix_time;
+
+const int MESSAGES = 3000;
+const size_t PAYLOAD = 1000;
+const uint32_t SEED = 2010;
+// longest a transfer may take to finish once an outage ends
+const time_duration RECOVERYLIMIT = seconds(1);
+
+static void sender(UDPPlusConnection *connection) {
+  vector<char> message(PAYLOAD, 'x');
+  for (int i = 0; i < MESSAGES; i++) {
+    memcpy(&message[0], &i, sizeof(i));
+    if (connection->send(&message[0], message.size()) < 0) {
+      break;
+    }
+  }
+  connection->closeConnection();
+}
+
+// drops every datagram from one address for outage, then
+// brings the link back and notes when
+static void blackhole(NetworkEmulator *emulator, struct sockaddr from, socklen_t length,
+    Impairment impairment, time_duration outage, ptime *restored) {
+  Impairment down = impairment;
+  down.loss = 1;
+  emulator->setImpairment(&from, length, down);
+  boost::this_thread::sleep(outage);
+  emulator->setImpairment(&from, length, impairment);
+  *restored = microsec_clock::universal_time();
+}
+
+// outage, when set, drops the sender's datagrams for that long
+// once half the messages are in.  The acks for what was queued
+// still arrive and the sender fills its window into the outage,
+// so a whole flight is lost
+static ConnectionStats transfer(const char *name, const Impairment &impairment, int window = 1024,
+    time_duration outage = time_duration()) {
+  NetworkEmulator emulator(SEED);
+  emulator.setImpairment(impairment);
+
+  EmulatedPair pair(emulator, 9000, window, window);
+  CHECK(pair.open());
+  UDPPlusConnection *outgoing = pair.outgoing;
+  UDPPlusConnection *incoming = pair.incoming;
+  boost::thread sending(boost::bind(&sender, outgoing));
+
+  int received = 0;
+  bool inOrder = true;
+  boost::thread outageThread;
+  ptime restored;
+  PayloadView view;
+  while (incoming->recv(view) == 0) {
+    int index;
+    memcpy(&index, view.data, sizeof(index));
+    inOrder = inOrder && (index == received) && (view.length == PAYLOAD);
+    received++;
+    if (received == MESSAGES / 2 && outage > time_duration()) {
+      socklen_t length;
+      const struct sockaddr *from = incoming->getSockAddr(length);
+      outageThread = boost::thread(boost::bind(&blackhole, &emulator, *from, length, impairment,
+          outage, &restored));
+    }
+  }
+  ptime finished(microsec_clock::universal_time());
+  view.release();
+  incoming->closeConnection();
+  sending.join();
+  outageThread.join();
+
+  ConnectionStats stats = outgoing->getStats();
+  EmulatorStats network = emulator.getStats();
+  uint64_t dropped = network.lost + network.overflowed;
+  uint64_t reordered = network.reordered;
+  printf("%s: dropped %llu reordered %llu, resent %llu sack %llu timeouts %llu\n", name,
+      (unsigned long long) dropped, (unsigned long long) reordered,
+      (unsigned long long) stats.retransmits, (unsigned long long) stats.sackResends,
+      (unsigned long long) stats.timeouts);
+  if (!restored.is_not_a_date_time()) {
+    printf("%s: finished %ld ms after the link came back\n", name,
+        (long) (finished - restored).total_milliseconds());
+    // slow start resends the lost flight in a few round trips,
+    // one hole per round trip would take seconds
+    CHECK(finished - restored < RECOVERYLIMIT);
+  }
+  CHECK(received == MESSAGES);
+  CHECK(inOrder);
+  // a reordered datagram may cost one spurious resend, and each
+  // lost one a resend and perhaps a timeout, but no more
+  uint64_t allowed = 2 * dropped + reordered + 2;
+  CHECK(stats.sackResends <= allowed);
+  CHECK(stats.retransmits <= allowed);
+  return stats;
+}
+
+static Impairment link(double loss, double reorder, time_duration delay) {
+  Impairment impairment;
+  impairment.loss = loss;
+  impairment.delay = delay;
+  impairment.jitter = delay / 10;
+  impairment.duplicate = 0.001;
+  impairment.reorder = reorder;
+  impairment.bandwidth = 12.5e6;
+  return impairment;
+}
+
+int main(int argc, char **argv) {
+  // reordering starts spurious recoveries on a lossless link
+  transfer("reordered 1 ms", link(0, 0.01, milliseconds(1)));
+  transfer("reordered 10 ms", link(0, 0.01, milliseconds(10)));
+  transfer("lossy 1 ms", link(0.02, 0.001, milliseconds(1)));
+
+  // a short queue drops whole bursts, whose holes are repaired
+  // one per partial ack
+  Impairment queue = link(0, 0, milliseconds(5));
+  queue.bandwidth = 2e6;
+  queue.queueLimit = milliseconds(5);
+  transfer("short queue", queue);
+  transfer("small window", link(0.05, 0, milliseconds(1)), 8);
+
+  // nothing past the lost flight arrives to be sacked, after one
+  // timeout the window reopens in slow start and the flight is
+  // resent from the head instead of every hole waiting out its
+  // own, ever longer, timeout
+  ConnectionStats stats = transfer("outage", link(0, 0, milliseconds(1)), 1024, milliseconds(100));
+  // the head times out a few times over while the link is down,
+  // backing off from 10 ms, and about once more after
+  CHECK(stats.timeouts <= 6);
+  return testResult();
+}
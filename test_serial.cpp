@@ -0,0 +1,75 @@
+/*
+ * test_serial.cpp
+ *
+ *  Created on: Oct 16, 2026
+ *
+ *  Checks SerialNumber arithmetic in 16 and 32 bit spaces,
+ *  above all across the wrap from the largest number to 0.
+ */
+
+#include "test.h"
+#include "SerialNumber.h"
+
+static void checkSpace(int bits) {
+  SerialNumber serial(bits);
+  uint32_t top = (bits == 32) ? 0xFFFFFFFFu : 0xFFFFu;
+
+  CHECK(serial.getBits() == bits);
+  CHECK(serial.maxWindow() == top >> 1);
+  CHECK(serial.wrap(top + 1) == 0);
+  CHECK(serial.wrap(5) == 5);
+
+  // adding wraps forwards and backwards
+  CHECK(serial.add(top, 1) == 0);
+  CHECK(serial.add(top, 3) == 2);
+  CHECK(serial.add(0, -1) == top);
+  CHECK(serial.add(2, -3) == top);
+  CHECK(serial.add(100, 0) == 100);
+
+  // differences keep their sign across the wrap
+  CHECK(serial.diff(0, top) == 1);
+  CHECK(serial.diff(top, 0) == -1);
+  CHECK(serial.diff(5, top - 4) == 10);
+  CHECK(serial.diff(top - 4, 5) == -10);
+  CHECK(serial.diff(7, 7) == 0);
+
+  // ordering holds across the wrap
+  CHECK(serial.lessThan(top, 0));
+  CHECK(!serial.lessThan(0, top));
+  CHECK(serial.lessThan(top - 10, serial.add(top, 10)));
+  CHECK(!serial.lessThan(3, 3));
+  CHECK(serial.lessEqual(3, 3));
+  CHECK(serial.lessEqual(top, 0));
+  CHECK(!serial.lessEqual(0, top));
+
+  // the window is the furthest two numbers still compare
+  // the same way in both directions
+  uint32_t window = serial.maxWindow();
+  CHECK(serial.lessThan(0, window));
+  CHECK(!serial.lessThan(window, 0));
+  CHECK(serial.lessThan(top - 2, serial.add(top - 2, window)));
+  CHECK((int64_t) serial.diff(serial.add(10, window), 10) == window);
+
+  // walking a whole space steps one at a time through the wrap
+  if (bits == 16) {
+    uint32_t seq = 0xFF00;
+    for (int i = 0; i < 0x20000; i++) {
+      uint32_t next = serial.add(seq, 1);
+      CHECK(serial.diff(next, seq) == 1);
+      CHECK(serial.lessThan(seq, next));
+      seq = next;
+    }
+    CHECK(seq == 0xFF00);
+  }
+}
+
+int main(int argc, char **argv) {
+  checkSpace(16);
+  checkSpace(32);
+
+  // anything other than 32 bits falls back to 16
+  SerialNumber odd(24);
+  CHECK(odd.getBits() == 16);
+  CHECK(odd.add(0xFFFF, 1) == 0);
+  return testResult();
+}
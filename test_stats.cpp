@@ -0,0 +1,77 @@
+/*
+ * test_stats.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *
+ *  Sends more than a million bytes through a NetworkEmulator
+ *  and checks that the counters UDPPlus::writeStats writes in
+ *  the Prometheus format read back as exactly the values
+ *  getStats returns, with no digits lost to rounding.
+ */
+
+#include "test.h"
+#include "UDPPlus.h"
+#include "UDPPlusConnection.h"
+#include "NetworkEmulator.h"
+
+#include <sstream>
+
+const int MESSAGES = 1500;
+const size_t PAYLOAD = 1000;
+
+// the value of the first sample of series, or 0 if it is missing
+static uint64_t sample(const string &text, const string &series) {
+  istringstream in(text);
+  string line;
+  while (getline(in, line)) {
+    if (line.compare(0, series.size(), series) == 0 &&
+        (line[series.size()] == '{' || line[series.size()] == ' ')) {
+      return strtoull(line.c_str() + line.rfind(' ') + 1, NULL, 10);
+    }
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  NetworkEmulator network;
+  Impairment impairment;
+  impairment.delay = boost::posix_time::milliseconds(1);
+  network.setImpairment(impairment);
+
+  EmulatedPair pair(network, 9000);
+  CHECK(pair.open());
+  UDPPlusConnection *outgoing = pair.outgoing;
+  UDPPlusConnection *incoming = pair.incoming;
+
+  vector<char> message(PAYLOAD, 'x');
+  char buffer[PAYLOAD];
+  int received = 0;
+  for (int i = 0; i < MESSAGES; i++) {
+    CHECK(outgoing->send(&message[0], message.size()) == 0);
+    // keeps the receive window open
+    while (received <= i - 128 && incoming->recv(buffer, sizeof(buffer)) == 0) {
+      received++;
+    }
+  }
+  while (received < MESSAGES && incoming->recv(buffer, sizeof(buffer)) == 0) {
+    received++;
+  }
+  CHECK(received == MESSAGES);
+
+  // every byte sent was delivered, the counters are settled
+  ConnectionStats sent = outgoing->getStats();
+  ConnectionStats got = incoming->getStats();
+  CHECK(sent.bytesSent > 999999);
+  CHECK(got.bytesReceived > 999999);
+
+  ostringstream clientText;
+  pair.client->writeStats(clientText, PROMETHEUS);
+  CHECK(sample(clientText.str(), "udpplus_connection_bytes_sent_total") == sent.bytesSent);
+  CHECK(sample(clientText.str(), "udpplus_connection_packets_sent_total") == sent.packetsSent);
+  ostringstream serverText;
+  pair.server->writeStats(serverText, PROMETHEUS);
+  CHECK(sample(serverText.str(), "udpplus_connection_bytes_received_total") == got.bytesReceived);
+  CHECK(sample(serverText.str(), "udpplus_connection_packets_received_total") == got.packetsReceived);
+
+  return testResult();
+}
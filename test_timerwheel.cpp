@@ -0,0 +1,136 @@
+/*
+ * test_timerwheel.cpp
+ *
+ *  Created on: Oct 16, 2026
+ *
+ *  Checks that TimerWheel entries fire no earlier than their
+ *  time, in order, on every level of the wheel, and that
+ *  rescheduling, waking and cancelling behave.
+ */
+
+#include "test.h"
+#include "TimerWheel.h"
+
+using namespace boost::posix_time;
+
+// an entry that records when its callback ran
+class Probe {
+public:
+  Probe() {
+    count = 0;
+    entry.callback = boost::bind(&Probe::fire, this);
+  }
+  void fire() {
+    boost::mutex::scoped_lock l(probeMutex);
+    count++;
+    fired = microsec_clock::universal_time();
+  }
+  int fires() {
+    boost::mutex::scoped_lock l(probeMutex);
+    return count;
+  }
+  ptime firedAt() {
+    boost::mutex::scoped_lock l(probeMutex);
+    return fired;
+  }
+
+  TimerWheel::Entry entry;
+private:
+  boost::mutex probeMutex;
+  int count;
+  ptime fired;
+};
+
+static void sleepFor(time_duration d) {
+  boost::this_thread::sleep(d);
+}
+
+// entries due on the root level and on coarser levels
+static void checkFiring(TimerWheel &wheel) {
+  const int delays[] = { 0, 1, 7, 50, 255, 300, 1000, 3000 };
+  const int n = sizeof(delays) / sizeof(delays[0]);
+  Probe probes[n];
+  ptime start = microsec_clock::universal_time();
+  for (int i = n - 1; i >= 0; i--) {
+    wheel.schedule(&probes[i].entry, start + milliseconds(delays[i]));
+  }
+  sleepFor(milliseconds(delays[n - 1] + 200));
+  for (int i = 0; i < n; i++) {
+    CHECK(probes[i].fires() == 1);
+    // a tick of slack either way for the wheel's rounding
+    CHECK(probes[i].firedAt() >= start + milliseconds(delays[i] - 1));
+    CHECK(probes[i].firedAt() < start + milliseconds(delays[i] + 150));
+    if (i > 0) {
+      CHECK(probes[i - 1].firedAt() <= probes[i].firedAt());
+    }
+  }
+  CHECK(wheel.size() == 0);
+}
+
+static void checkReschedule(TimerWheel &wheel) {
+  Probe pushed, pulled;
+  ptime start = microsec_clock::universal_time();
+  wheel.schedule(&pushed.entry, start + milliseconds(20));
+  wheel.schedule(&pulled.entry, start + milliseconds(2000));
+  CHECK(wheel.size() == 2);
+
+  // moving an entry keeps it scheduled only once
+  wheel.schedule(&pushed.entry, start + milliseconds(400));
+  wheel.schedule(&pulled.entry, start + milliseconds(40));
+  CHECK(wheel.size() == 2);
+
+  sleepFor(milliseconds(200));
+  CHECK(pulled.fires() == 1);
+  CHECK(pushed.fires() == 0);
+  sleepFor(milliseconds(400));
+  CHECK(pushed.fires() == 1);
+  CHECK(pushed.firedAt() >= start + milliseconds(399));
+  CHECK(wheel.size() == 0);
+}
+
+static void checkCancel(TimerWheel &wheel) {
+  Probe near, far, idle;
+  ptime start = microsec_clock::universal_time();
+  wheel.schedule(&near.entry, start + milliseconds(30));
+  wheel.schedule(&far.entry, start + milliseconds(5000));
+  CHECK(wheel.size() == 2);
+  wheel.cancel(&near.entry);
+  wheel.cancel(&far.entry);
+  // cancelling an entry that was never scheduled is harmless
+  wheel.cancel(&idle.entry);
+  CHECK(wheel.size() == 0);
+  sleepFor(milliseconds(150));
+  CHECK(near.fires() == 0);
+  CHECK(far.fires() == 0);
+
+  // a cancelled entry can be scheduled again
+  wheel.schedule(&near.entry, microsec_clock::universal_time() + milliseconds(10));
+  sleepFor(milliseconds(150));
+  CHECK(near.fires() == 1);
+}
+
+static void checkWake(TimerWheel &wheel) {
+  Probe probe;
+  ptime start = microsec_clock::universal_time();
+  wheel.schedule(&probe.entry, start + seconds(10));
+  wheel.wake(&probe.entry);
+  sleepFor(milliseconds(100));
+  CHECK(probe.fires() == 1);
+  CHECK(probe.firedAt() < start + seconds(1));
+  CHECK(wheel.size() == 0);
+
+  // a time already past fires at once as well
+  Probe past;
+  wheel.schedule(&past.entry, start - seconds(1));
+  sleepFor(milliseconds(100));
+  CHECK(past.fires() == 1);
+}
+
+int main(int argc, char **argv) {
+  TimerWheel wheel;
+  checkFiring(wheel);
+  checkReschedule(wheel);
+  checkCancel(wheel);
+  checkWake(wheel);
+  return testResult();
+}
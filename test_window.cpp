@@ -0,0 +1,85 @@
+/*
+ * test_window.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *
+ *  Sends through a NetworkEmulator to a receiver with a small
+ *  buffer that stops reading, and checks that the sender holds
+ *  to the advertised receive window: it stalls once the window
+ *  closes, nothing past the window reaches the receiver, and
+ *  every message follows in order once the reader drains it.
+ */
+
+#include "test.h"
+#include "UDPPlus.h"
+#include "UDPPlusConnection.h"
+#include "NetworkEmulator.h"
+
+#include <boost/atomic.hpp>
+
+const int MESSAGES = 2000;
+const size_t PAYLOAD = 500;
+// the receiver's buffer, and so the largest window it advertises
+const int WINDOW = 32;
+const int OUTBUFFER = 256;
+
+static boost::atomic<int> sent(0);
+
+static void sender(UDPPlusConnection *outgoing) {
+  vector<char> message(PAYLOAD);
+  for (int i = 0; i < MESSAGES; i++) {
+    memset(&message[0], i & 0xFF, message.size());
+    memcpy(&message[0], &i, sizeof(i));
+    if (outgoing->send(&message[0], message.size()) != 0) {
+      return;
+    }
+    sent++;
+  }
+}
+
+int main(int argc, char **argv) {
+  NetworkEmulator network;
+  Impairment impairment;
+  impairment.delay = boost::posix_time::milliseconds(2);
+  network.setImpairment(impairment);
+
+  EmulatedPair pair(network, 9000, WINDOW, OUTBUFFER);
+  CHECK(pair.open());
+  UDPPlusConnection *outgoing = pair.outgoing;
+  UDPPlusConnection *incoming = pair.incoming;
+  boost::thread thread(&sender, outgoing);
+
+  // the reader is away, the window closes and the sender stalls
+  boost::this_thread::sleep(boost::posix_time::milliseconds(500));
+  ConnectionStats stalled = outgoing->getStats();
+  ConnectionStats full = incoming->getStats();
+  uint64_t datagrams = network.getStats().sent;
+  CHECK(sent < MESSAGES);
+  CHECK(full.undelivered == WINDOW);
+  CHECK(full.packetsReceived <= (uint64_t) WINDOW);
+  CHECK(stalled.inFlight <= WINDOW);
+
+  // a closed window is probed, not flooded
+  boost::this_thread::sleep(boost::posix_time::milliseconds(500));
+  CHECK(incoming->getStats().packetsReceived == full.packetsReceived);
+  CHECK(network.getStats().sent - datagrams < 50);
+  CHECK(outgoing->getStats().timeouts == stalled.timeouts);
+
+  // reading reopens the window and the rest follows
+  vector<char> buffer(PAYLOAD);
+  int received = 0;
+  bool inOrder = true;
+  while (received < MESSAGES && incoming->recv(&buffer[0], buffer.size()) == 0) {
+    int index;
+    memcpy(&index, &buffer[0], sizeof(index));
+    inOrder = inOrder && index == received &&
+        buffer[PAYLOAD - 1] == (char) (index & 0xFF);
+    received++;
+  }
+  thread.join();
+  CHECK(sent == MESSAGES);
+  CHECK(received == MESSAGES);
+  CHECK(inOrder);
+
+  return testResult();
+}